@@ -104,6 +104,15 @@ struct mpi_type_wrapper<long double>
     }
 };
 
+template <>
+struct mpi_type_wrapper<float>
+{
+    static MPI_Datatype kind()
+    {
+        return MPI_FLOAT;
+    }
+};
+
 template <>
 struct mpi_type_wrapper<std::complex<double>>
 {
@@ -113,6 +122,15 @@ struct mpi_type_wrapper<std::complex<double>>
     }
 };
 
+template <>
+struct mpi_type_wrapper<std::complex<float>>
+{
+    static MPI_Datatype kind()
+    {
+        return MPI_CXX_FLOAT_COMPLEX;
+    }
+};
+
 template <>
 struct mpi_type_wrapper<int>
 {
@@ -362,6 +380,33 @@ class Communicator
         return std::move(new_comm);
     }
 
+    /// Split the communicator into the groups of ranks which can create shared memory windows.
+    /** Ranks keep their relative order, so the first rank of the node has the rank 0 in the new communicator. */
+    inline Communicator split_shared() const
+    {
+        Communicator new_comm;
+        new_comm.mpi_comm_ = std::unique_ptr<MPI_Comm, mpi_comm_deleter>(new MPI_Comm);
+        CALL_MPI(MPI_Comm_split_type,
+                 (mpi_comm(), MPI_COMM_TYPE_SHARED, rank(), MPI_INFO_NULL, new_comm.mpi_comm_.get()));
+        new_comm.mpi_comm_raw_ = *new_comm.mpi_comm_;
+        return std::move(new_comm);
+    }
+
+    /// Create a distributed graph communicator from the lists of neighbors of this rank.
+    /** Ranks are not reordered, so the rank of each process in the new communicator is the same. */
+    inline Communicator dist_graph_create_adjacent(std::vector<int> const& sources__,
+                                                   std::vector<int> const& destinations__) const
+    {
+        Communicator new_comm;
+        new_comm.mpi_comm_ = std::unique_ptr<MPI_Comm, mpi_comm_deleter>(new MPI_Comm);
+        CALL_MPI(MPI_Dist_graph_create_adjacent,
+                 (mpi_comm(), static_cast<int>(sources__.size()), sources__.data(), MPI_UNWEIGHTED,
+                  static_cast<int>(destinations__.size()), destinations__.data(), MPI_UNWEIGHTED, MPI_INFO_NULL, 0,
+                  new_comm.mpi_comm_.get()));
+        new_comm.mpi_comm_raw_ = *new_comm.mpi_comm_;
+        return std::move(new_comm);
+    }
+
     inline Communicator duplicate() const
     {
         Communicator new_comm;
@@ -710,6 +755,56 @@ class Communicator
                                  recvcounts__, rdispls__, mpi_type_wrapper<T>::kind(), mpi_comm()));
     }
 
+    template <typename T>
+    void ialltoall(T const* sendbuf__,
+                   int const* sendcounts__,
+                   int const* sdispls__,
+                   T* recvbuf__,
+                   int const* recvcounts__,
+                   int const* rdispls__,
+                   MPI_Request* req__) const
+    {
+#if defined(__PROFILE_MPI)
+        PROFILE("MPI_Ialltoallv");
+#endif
+        CALL_MPI(MPI_Ialltoallv, (sendbuf__, sendcounts__, sdispls__, mpi_type_wrapper<T>::kind(), recvbuf__,
+                                  recvcounts__, rdispls__, mpi_type_wrapper<T>::kind(), mpi_comm(), req__));
+    }
+
+    /// All-to-all exchange with the neighbors of a graph communicator.
+    /** Counts and displacements are given for the list of neighbors in the order of the graph creation. */
+    template <typename T>
+    void neighbor_alltoall(T const* sendbuf__,
+                           int const* sendcounts__,
+                           int const* sdispls__,
+                           T* recvbuf__,
+                           int const* recvcounts__,
+                           int const* rdispls__) const
+    {
+#if defined(__PROFILE_MPI)
+        PROFILE("MPI_Neighbor_alltoallv");
+#endif
+        CALL_MPI(MPI_Neighbor_alltoallv, (sendbuf__, sendcounts__, sdispls__, mpi_type_wrapper<T>::kind(), recvbuf__,
+                                          recvcounts__, rdispls__, mpi_type_wrapper<T>::kind(), mpi_comm()));
+    }
+
+    /// Non-blocking all-to-all exchange with the neighbors of a graph communicator.
+    template <typename T>
+    void ineighbor_alltoall(T const* sendbuf__,
+                            int const* sendcounts__,
+                            int const* sdispls__,
+                            T* recvbuf__,
+                            int const* recvcounts__,
+                            int const* rdispls__,
+                            MPI_Request* req__) const
+    {
+#if defined(__PROFILE_MPI)
+        PROFILE("MPI_Ineighbor_alltoallv");
+#endif
+        CALL_MPI(MPI_Ineighbor_alltoallv, (sendbuf__, sendcounts__, sdispls__, mpi_type_wrapper<T>::kind(), recvbuf__,
+                                           recvcounts__, rdispls__, mpi_type_wrapper<T>::kind(), mpi_comm(), req__));
+    }
+
     //==alltoall_descriptor map_alltoall(std::vector<int> local_sizes_in, std::vector<int> local_sizes_out) const
     //=={
     //==    alltoall_descriptor a2a;
@@ -782,6 +877,79 @@ class Communicator
     //==}
 };
 
+/// Window of the host memory shared between the ranks of a node.
+/** Each rank allocates its own segment of the window. Segments of the other ranks are accessed with direct loads
+ *  and stores; the window is locked for the whole lifetime, so the access is synchronized with sync() and a
+ *  barrier on the node communicator. */
+template <typename T>
+class Shared_window
+{
+  private:
+    /// Raw MPI window.
+    MPI_Win win_{MPI_WIN_NULL};
+    /// Segment of this rank.
+    T* ptr_{nullptr};
+    /// Number of elements in the segment of this rank.
+    size_t size_{0};
+    /* copy is not allowed */
+    Shared_window(Shared_window const& src__) = delete;
+    /* assigment is not allowed */
+    Shared_window& operator=(Shared_window const& src__) = delete;
+
+  public:
+    /// Allocate the window; this is a collective operation on the node communicator.
+    Shared_window(Communicator const& comm__, size_t size__)
+        : size_(size__)
+    {
+        MPI_Info info;
+        CALL_MPI(MPI_Info_create, (&info));
+        /* segments are allocated separately, so each of them is placed in the memory of its owner */
+        CALL_MPI(MPI_Info_set, (info, "alloc_shared_noncontig", "true"));
+        CALL_MPI(MPI_Win_allocate_shared, (static_cast<MPI_Aint>(size__ * sizeof(T)), sizeof(T), info,
+                                           comm__.mpi_comm(), &ptr_, &win_));
+        CALL_MPI(MPI_Info_free, (&info));
+        CALL_MPI(MPI_Win_lock_all, (MPI_MODE_NOCHECK, win_));
+    }
+
+    ~Shared_window()
+    {
+        int mpi_finalized_flag;
+        MPI_Finalized(&mpi_finalized_flag);
+        if (!mpi_finalized_flag) {
+            CALL_MPI(MPI_Win_unlock_all, (win_));
+            CALL_MPI(MPI_Win_free, (&win_));
+        }
+    }
+
+    /// Pointer to the segment of this rank.
+    inline T* at() const
+    {
+        return ptr_;
+    }
+
+    /// Pointer to the segment of a given rank of the node communicator.
+    inline T* at(int rank__) const
+    {
+        MPI_Aint sz;
+        int disp_unit;
+        T* ptr;
+        CALL_MPI(MPI_Win_shared_query, (win_, rank__, &sz, &disp_unit, &ptr));
+        return ptr;
+    }
+
+    /// Number of elements in the segment of this rank.
+    inline size_t size() const
+    {
+        return size_;
+    }
+
+    /// Synchronize the public and private copies of the window.
+    inline void sync() const
+    {
+        CALL_MPI(MPI_Win_sync, (win_));
+    }
+};
+
 /// Get number of ranks per node.
 inline int num_ranks_per_node()
 {
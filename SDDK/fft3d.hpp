@@ -26,9 +26,16 @@
 #define __FFT3D_HPP__
 
 #include <fftw3.h>
+#include <array>
+#include <atomic>
+#include <map>
+#include <fstream>
+#include <list>
 #include "geometry3d.hpp"
 #include "fft3d_grid.hpp"
 #include "gvec.hpp"
+#include "mpi_grid.hpp"
+#include "utils/env.hpp"
 #if defined(__GPU) && defined(__CUDA)
 #include "GPU/cufft.hpp"
 #include "GPU/fft_kernels.hpp"
@@ -39,6 +46,491 @@
 
 namespace sddk {
 
+/// Planning rigor of the FFTW plans.
+enum class fftw_planner_t
+{
+    /// Plans are created from the heuristics without any measurements.
+    estimate,
+    /// A set of plans is measured and the fastest is selected.
+    measure,
+    /// Wider range of plans is measured.
+    patient,
+    /// Widest range of plans is measured.
+    exhaustive
+};
+
+/// Get the default planning rigor.
+/** The value is taken from the SDDK_FFTW_PLANNER environment variable (estimate, measure, patient or
+ *  exhaustive); estimate is used if the variable is not set. */
+inline fftw_planner_t fftw_planner()
+{
+    auto name = utils::get_env<std::string>("SDDK_FFTW_PLANNER");
+    if (name == nullptr || *name == "estimate") {
+        return fftw_planner_t::estimate;
+    }
+    if (*name == "measure") {
+        return fftw_planner_t::measure;
+    }
+    if (*name == "patient") {
+        return fftw_planner_t::patient;
+    }
+    if (*name == "exhaustive") {
+        return fftw_planner_t::exhaustive;
+    }
+    std::stringstream s;
+    s << "wrong value of SDDK_FFTW_PLANNER: " << *name;
+    TERMINATE(s);
+    return fftw_planner_t::estimate;
+}
+
+/// Get FFTW planner flag.
+inline unsigned int fftw_planner_flag(fftw_planner_t planner__)
+{
+    switch (planner__) {
+        case fftw_planner_t::measure: {
+            return FFTW_MEASURE;
+        }
+        case fftw_planner_t::patient: {
+            return FFTW_PATIENT;
+        }
+        case fftw_planner_t::exhaustive: {
+            return FFTW_EXHAUSTIVE;
+        }
+        default: {
+            return FFTW_ESTIMATE;
+        }
+    }
+}
+
+/// Compression of the z-stick payload in the all-to-all exchange.
+enum class a2a_compression_t
+{
+    /// Data is sent as is.
+    none,
+    /// Data is converted to single precision.
+    single,
+    /// Data is converted to 16-bit fixed-point numbers with a common scale factor for each destination rank.
+    fixed16,
+    /// Data is converted to 8-bit fixed-point numbers with a common scale factor for each destination rank.
+    fixed8
+};
+
+/// Get the default compression of the all-to-all exchange.
+/** The value is taken from the SDDK_FFT_A2A_COMPRESSION environment variable (none, float, fixed16 or fixed8);
+ *  no compression is used if the variable is not set. */
+inline a2a_compression_t fft_a2a_compression()
+{
+    auto name = utils::get_env<std::string>("SDDK_FFT_A2A_COMPRESSION");
+    if (name == nullptr || *name == "none") {
+        return a2a_compression_t::none;
+    }
+    if (*name == "float") {
+        return a2a_compression_t::single;
+    }
+    if (*name == "fixed16") {
+        return a2a_compression_t::fixed16;
+    }
+    if (*name == "fixed8") {
+        return a2a_compression_t::fixed8;
+    }
+    std::stringstream s;
+    s << "wrong value of SDDK_FFT_A2A_COMPRESSION: " << *name;
+    TERMINATE(s);
+    return a2a_compression_t::none;
+}
+
+/// Precision-dependent part of the FFTW interface.
+template <typename T>
+struct fftw_traits;
+
+/// Double precision FFTW interface.
+template <>
+struct fftw_traits<double>
+{
+    typedef fftw_plan plan_t;
+
+    typedef fftw_complex complex_t;
+
+    /// Prefix of the wisdom file names.
+    static char const* wisdom_prefix()
+    {
+        return "fftw_wisdom";
+    }
+
+    static void* malloc(size_t n__)
+    {
+        return fftw_malloc(n__);
+    }
+
+    static void free(void* ptr__)
+    {
+        fftw_free(ptr__);
+    }
+
+    static plan_t plan_dft_1d(int n__, complex_t* in__, complex_t* out__, int sign__, unsigned int flags__)
+    {
+        return fftw_plan_dft_1d(n__, in__, out__, sign__, flags__);
+    }
+
+    static plan_t plan_dft_2d(int n0__, int n1__, complex_t* in__, complex_t* out__, int sign__, unsigned int flags__)
+    {
+        return fftw_plan_dft_2d(n0__, n1__, in__, out__, sign__, flags__);
+    }
+
+    static plan_t plan_dft_r2c_1d(int n__, double* in__, complex_t* out__, unsigned int flags__)
+    {
+        return fftw_plan_dft_r2c_1d(n__, in__, out__, flags__);
+    }
+
+    static plan_t plan_dft_c2r_1d(int n__, complex_t* in__, double* out__, unsigned int flags__)
+    {
+        return fftw_plan_dft_c2r_1d(n__, in__, out__, flags__);
+    }
+
+    static plan_t plan_many_dft(int rank__, int const* n__, int howmany__, complex_t* in__, int const* inembed__,
+                                int istride__, int idist__, complex_t* out__, int const* onembed__, int ostride__,
+                                int odist__, int sign__, unsigned int flags__)
+    {
+        return fftw_plan_many_dft(rank__, n__, howmany__, in__, inembed__, istride__, idist__, out__, onembed__,
+                                  ostride__, odist__, sign__, flags__);
+    }
+
+    static void execute(plan_t plan__)
+    {
+        fftw_execute(plan__);
+    }
+
+    static void execute_dft(plan_t plan__, complex_t* in__, complex_t* out__)
+    {
+        fftw_execute_dft(plan__, in__, out__);
+    }
+
+    static void destroy_plan(plan_t plan__)
+    {
+        fftw_destroy_plan(plan__);
+    }
+
+    static int import_wisdom_from_filename(char const* name__)
+    {
+        return fftw_import_wisdom_from_filename(name__);
+    }
+
+    static int import_wisdom_from_string(char const* str__)
+    {
+        return fftw_import_wisdom_from_string(str__);
+    }
+
+    static std::string export_wisdom_to_string()
+    {
+        auto ptr = fftw_export_wisdom_to_string();
+        std::string str(ptr);
+        std::free(ptr);
+        return str;
+    }
+
+    static void forget_wisdom()
+    {
+        fftw_forget_wisdom();
+    }
+};
+
+/// Single precision FFTW interface.
+template <>
+struct fftw_traits<float>
+{
+    typedef fftwf_plan plan_t;
+
+    typedef fftwf_complex complex_t;
+
+    /// Prefix of the wisdom file names.
+    static char const* wisdom_prefix()
+    {
+        return "fftwf_wisdom";
+    }
+
+    static void* malloc(size_t n__)
+    {
+        return fftwf_malloc(n__);
+    }
+
+    static void free(void* ptr__)
+    {
+        fftwf_free(ptr__);
+    }
+
+    static plan_t plan_dft_1d(int n__, complex_t* in__, complex_t* out__, int sign__, unsigned int flags__)
+    {
+        return fftwf_plan_dft_1d(n__, in__, out__, sign__, flags__);
+    }
+
+    static plan_t plan_dft_2d(int n0__, int n1__, complex_t* in__, complex_t* out__, int sign__, unsigned int flags__)
+    {
+        return fftwf_plan_dft_2d(n0__, n1__, in__, out__, sign__, flags__);
+    }
+
+    static plan_t plan_dft_r2c_1d(int n__, float* in__, complex_t* out__, unsigned int flags__)
+    {
+        return fftwf_plan_dft_r2c_1d(n__, in__, out__, flags__);
+    }
+
+    static plan_t plan_dft_c2r_1d(int n__, complex_t* in__, float* out__, unsigned int flags__)
+    {
+        return fftwf_plan_dft_c2r_1d(n__, in__, out__, flags__);
+    }
+
+    static plan_t plan_many_dft(int rank__, int const* n__, int howmany__, complex_t* in__, int const* inembed__,
+                                int istride__, int idist__, complex_t* out__, int const* onembed__, int ostride__,
+                                int odist__, int sign__, unsigned int flags__)
+    {
+        return fftwf_plan_many_dft(rank__, n__, howmany__, in__, inembed__, istride__, idist__, out__, onembed__,
+                                   ostride__, odist__, sign__, flags__);
+    }
+
+    static void execute(plan_t plan__)
+    {
+        fftwf_execute(plan__);
+    }
+
+    static void execute_dft(plan_t plan__, complex_t* in__, complex_t* out__)
+    {
+        fftwf_execute_dft(plan__, in__, out__);
+    }
+
+    static void destroy_plan(plan_t plan__)
+    {
+        fftwf_destroy_plan(plan__);
+    }
+
+    static int import_wisdom_from_filename(char const* name__)
+    {
+        return fftwf_import_wisdom_from_filename(name__);
+    }
+
+    static int import_wisdom_from_string(char const* str__)
+    {
+        return fftwf_import_wisdom_from_string(str__);
+    }
+
+    static std::string export_wisdom_to_string()
+    {
+        auto ptr = fftwf_export_wisdom_to_string();
+        std::string str(ptr);
+        std::free(ptr);
+        return str;
+    }
+
+    static void forget_wisdom()
+    {
+        fftwf_forget_wisdom();
+    }
+};
+
+/// Wisdom of the FFT grids which were planned in this run, indexed by the name of the wisdom file.
+template <typename T>
+inline std::map<std::string, std::string>& fftw_wisdom_files()
+{
+    static std::map<std::string, std::string> files;
+    return files;
+}
+
+/// Name of the FFTW wisdom file for a given FFT grid and number of threads.
+/** The wisdom is stored in the directory given by SDDK_FFTW_WISDOM_DIR environment variable (current directory
+ *  by default) in a file which name is composed from the grid dimensions and the number of threads. Double and
+ *  single precision wisdom are kept in separate files. */
+template <typename T>
+inline std::string fftw_wisdom_file_name(std::array<int, 3> dims__, int num_threads__)
+{
+    auto dir = utils::get_env<std::string>("SDDK_FFTW_WISDOM_DIR");
+
+    std::stringstream s;
+    s << ((dir == nullptr) ? std::string(".") : *dir) << "/" << fftw_traits<T>::wisdom_prefix() << "_"
+      << dims__[0] << "_" << dims__[1] << "_" << dims__[2] << "_" << num_threads__ << ".txt";
+    return s.str();
+}
+
+/// Load FFTW wisdom of a given FFT grid before its plans are created.
+/** FFTW keeps a single global wisdom, so the wisdom of the previously planned grid is forgotten first. The wisdom
+ *  of this grid is imported from the file at the first call and from the copy kept by store_fftw_wisdom() at the
+ *  next calls. */
+template <typename T>
+inline void load_fftw_wisdom(std::string const& name__)
+{
+    fftw_traits<T>::forget_wisdom();
+    auto it = fftw_wisdom_files<T>().find(name__);
+    if (it == fftw_wisdom_files<T>().end()) {
+        /* it's ok if file doesn't exist yet */
+        fftw_traits<T>::import_wisdom_from_filename(name__.c_str());
+    } else {
+        fftw_traits<T>::import_wisdom_from_string(it->second.c_str());
+    }
+}
+
+/// Keep the wisdom accumulated by the plans of the grid after they are created.
+template <typename T>
+inline void store_fftw_wisdom(std::string const& name__)
+{
+    fftw_wisdom_files<T>()[name__] = fftw_traits<T>::export_wisdom_to_string();
+}
+
+/// Save FFTW wisdom of a given precision.
+/** Each file receives only the wisdom of its own grid. */
+template <typename T>
+inline void save_fftw_wisdom()
+{
+    if (Communicator::world().rank() == 0) {
+        for (auto& e : fftw_wisdom_files<T>()) {
+            std::ofstream out(e.first);
+            out << e.second;
+            if (!out) {
+                std::printf("warning: failed to save FFTW wisdom to %s\n", e.first.c_str());
+            }
+        }
+    }
+    fftw_wisdom_files<T>().clear();
+}
+
+/// Save FFTW wisdom to all files which were loaded during this run.
+/** Only the rank 0 of the global communicator writes files. */
+inline void save_fftw_wisdom()
+{
+    save_fftw_wisdom<double>();
+    save_fftw_wisdom<float>();
+}
+
+/// Calibrate the cost of the FFT passes of different radices with a short micro-benchmark.
+/** For each radix p a batch of 1D transforms of size p^k (k is chosen to give a transform of about a thousand
+ *  elements) is timed; the time per element and per pass gives the weight of the radix. The measurement is done
+ *  only once per process; the weights of the rank 0 of the communicator are broadcast at every call, so that all
+ *  ranks choose the same grid. The call is collective on the communicator. */
+template <typename T>
+inline fft_radix_cost const& calibrate_fft_radix_cost(Communicator const& comm__)
+{
+    static bool is_calibrated{false};
+    static fft_radix_cost cost;
+
+    PROFILE("sddk::calibrate_fft_radix_cost");
+
+    typedef typename fftw_traits<T>::complex_t fftw_complex_t;
+
+    /* total number of elements in a batch of transforms */
+    int const batch_size{1 << 16};
+    /* number of repetitions; the fastest one is taken */
+    int const num_repeat{5};
+
+    if (comm__.rank() == 0 && !is_calibrated) {
+        auto buf = static_cast<std::complex<T>*>(fftw_traits<T>::malloc(sizeof(std::complex<T>) * batch_size));
+        std::fill(buf, buf + batch_size, std::complex<T>(1, 0));
+
+        std::array<double, 5> t_pass;
+        for (int i = 0; i < static_cast<int>(cost.radix.size()); i++) {
+            int p = cost.radix[i];
+            /* number of passes */
+            int k{0};
+            int n{1};
+            while (n * p <= 1536) {
+                n *= p;
+                k++;
+            }
+            int howmany = batch_size / n;
+
+            auto ptr  = reinterpret_cast<fftw_complex_t*>(buf);
+            auto plan = fftw_traits<T>::plan_many_dft(1, &n, howmany, ptr, &n, 1, n, ptr, &n, 1, n, FFTW_BACKWARD,
+                                                      FFTW_ESTIMATE);
+            double t_min{-1};
+            for (int j = 0; j < num_repeat; j++) {
+                double t = -omp_get_wtime();
+                fftw_traits<T>::execute(plan);
+                t += omp_get_wtime();
+                if (t_min < 0 || t < t_min) {
+                    t_min = t;
+                }
+            }
+            fftw_traits<T>::destroy_plan(plan);
+
+            t_pass[i] = t_min / (static_cast<double>(n) * howmany * k);
+        }
+        fftw_traits<T>::free(buf);
+
+        for (int i = 0; i < static_cast<int>(cost.radix.size()); i++) {
+            cost.weight[i] = t_pass[i] / t_pass[0];
+        }
+    }
+    comm__.bcast(cost.weight.data(), static_cast<int>(cost.weight.size()), 0);
+
+    is_calibrated = true;
+
+    return cost;
+}
+
+/// Per-thread queues of tasks with stealing.
+/** Tasks are the indices of a list which is split into contiguous ranges, one range per thread. The owner takes
+ *  the tasks from the front of its range and a thread with an empty range steals from the back of the ranges of
+ *  the other threads. Both ends of a range are packed into a single 64-bit word, so the queues are lock-free. */
+class task_queues
+{
+  private:
+    /// Range of tasks of one thread padded to the cache line.
+    struct queue_t
+    {
+        std::atomic<uint64_t> range;
+        char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    int num_queues_;
+
+    std::unique_ptr<queue_t[]> queues_;
+
+    static uint64_t pack(uint32_t head__, uint32_t tail__)
+    {
+        return (static_cast<uint64_t>(tail__) << 32) | head__;
+    }
+
+    /// Take a task from the front (steal = false) or from the back (steal = true) of the queue.
+    bool take(int iq__, bool steal__, int& task__)
+    {
+        auto& range = queues_[iq__].range;
+        uint64_t r  = range.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t head = static_cast<uint32_t>(r);
+            uint32_t tail = static_cast<uint32_t>(r >> 32);
+            if (head >= tail) {
+                return false;
+            }
+            uint64_t r1 = steal__ ? pack(head, tail - 1) : pack(head + 1, tail);
+            if (range.compare_exchange_weak(r, r1, std::memory_order_relaxed)) {
+                task__ = steal__ ? static_cast<int>(tail - 1) : static_cast<int>(head);
+                return true;
+            }
+        }
+    }
+
+  public:
+    /// Constructor.
+    /** \param [in] first_task Index of the first task of each thread; the last element is the number of tasks. */
+    task_queues(std::vector<int> const& first_task__)
+        : num_queues_(static_cast<int>(first_task__.size()) - 1)
+        , queues_(new queue_t[first_task__.size() - 1])
+    {
+        for (int i = 0; i < num_queues_; i++) {
+            queues_[i].range.store(pack(first_task__[i], first_task__[i + 1]));
+        }
+    }
+
+    /// Get the next task of the thread; false is returned if all queues are empty.
+    bool next(int tid__, int& task__)
+    {
+        if (tid__ < num_queues_ && take(tid__, false, task__)) {
+            return true;
+        }
+        for (int i = 1; i <= num_queues_; i++) {
+            if (take((tid__ + i) % num_queues_, true, task__)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
 /// Implementation of FFT3D.
 /** FFT convention:
  *  \f[
@@ -55,7 +547,13 @@ namespace sddk {
  *  The following cases are handeled by the FFT driver:
  *    - transformation of a single real / complex function (serial / parallel, cpu / gpu)
  *    - transformation of two real functions (serial / parallel, cpu / gpu)
+ *    - transformation of a batch of functions with a single all-to-all exchange (serial / parallel, cpu)
+ *    - accumulation of the density of a set of functions directly from the xy-step (serial / parallel, cpu)
+ *    - application of a local operator V(r) to one or two real functions with the multiplication fused into
+ *      the xy-step (serial / parallel, cpu; gpu and pencil decomposition fall back to two transformations)
+ *    - slab decomposition of the real-space grid along z (cpu / gpu) or pencil decomposition along z and y (cpu)
  *    - input / ouput data buffer pointer (cpu / gpu). GPU input pointer works only in serial.
+ *    - double (FFT3D) or single (FFT3D_float) precision of the transformation; single precision is cpu only.
  *
  *  The transformation of two real functions is done as one transformation of complex function:
  *  \f[
@@ -79,12 +577,97 @@ namespace sddk {
  *      \sum_{G_z} e^{-izG_z} \psi_{1,2}(-G_x, -G_y, -G_z) = \psi_{1,2}(-G_x, -G_y, z)
  *  \f]
  *
+ *  In the pencil decomposition the MPI ranks of the FFT communicator are arranged in a 2D grid {z, xy}. The z-columns
+ *  are transformed first; then they are sent to the ranks which store the corresponding z-slab and x-range, y-lines
+ *  are transformed, the (x, y) block is transposed inside the z-slab and finally x-rows are transformed. The real-space
+ *  buffer of each rank is a {x, y, z} box with the full x-dimension, local_size_y() and local_size_z().
+ *
  *  \todo GPU input ponter for parallel FFT
  *  \todo decompose 3D fft into three consecutive 1D ffts
  */
-class FFT3D : public FFT3D_grid
+template <typename T>
+class FFT3D_base : public FFT3D_grid
 {
+  public:
+    /// Complex type of the transformed functions.
+    typedef std::complex<T> complex_t;
+
+    /// Handle of an asynchronous transformation.
+    /** Similar to the Request of the communicator: the transformation is completed by wait() or by test() which
+     *  returns true. An empty handle corresponds to the completed transformation. The handle can't be copied, so
+     *  the transformation is completed only once. A pending transformation is also completed when the handle is
+     *  destroyed or when another handle is moved into it, so the handle must not outlive the FFT driver. */
+    class async_request
+    {
+      private:
+        /// FFT driver which runs the transformation.
+        FFT3D_base* fft_{nullptr};
+        /// Slot of the transformation in the driver.
+        int slot_{-1};
+        /* copy is not allowed */
+        async_request(async_request const& src__) = delete;
+        /* assigment is not allowed */
+        async_request& operator=(async_request const& src__) = delete;
+
+      public:
+        async_request()
+        {
+        }
+
+        async_request(FFT3D_base* fft__, int slot__)
+            : fft_(fft__)
+            , slot_(slot__)
+        {
+        }
+
+        async_request(async_request&& src__)
+        {
+            *this = std::move(src__);
+        }
+
+        ~async_request()
+        {
+            wait();
+        }
+
+        /// Move the handle; the pending transformation of this handle is completed first.
+        async_request& operator=(async_request&& src__)
+        {
+            if (this != &src__) {
+                wait();
+                fft_       = src__.fft_;
+                slot_      = src__.slot_;
+                src__.fft_ = nullptr;
+            }
+            return *this;
+        }
+
+        /// Wait for the completion of the transformation.
+        void wait()
+        {
+            if (fft_) {
+                fft_->async_wait(slot_);
+                fft_ = nullptr;
+            }
+        }
+
+        /// Progress the transformation and check if it is completed.
+        bool test()
+        {
+            if (fft_ && fft_->async_test(slot_)) {
+                fft_ = nullptr;
+            }
+            return (fft_ == nullptr);
+        }
+    };
+
   protected:
+    typedef fftw_traits<T> fftw_t;
+
+    typedef typename fftw_t::plan_t fftw_plan_t;
+
+    typedef typename fftw_t::complex_t fftw_complex_t;
+
     /// Communicator for the parallel FFT.
     Communicator const& comm_;
 
@@ -100,33 +683,195 @@ class FFT3D : public FFT3D_grid
     /// Offset in the global z-dimension index.
     int offset_z_;
 
+    /// Number of MPI ranks in the xy-direction of the pencil decomposition; 1 for the slab decomposition.
+    int num_ranks_xy_{1};
+
+    /// 2D grid of MPI ranks {z, xy} for the pencil decomposition.
+    std::unique_ptr<MPI_grid> mpi_grid_;
+
+    /// Split x-direction between the z-column exchange and the transposition in the pencil decomposition.
+    splindex<block> spl_x_;
+
+    /// Split y-direction; the full y-dimension is local in case of slab decomposition.
+    splindex<block> spl_y_;
+
+    /// Local indices of z-columns sent to each xy-rank in the backward pencil transformation.
+    /** In case of reduced G-vector set a column is also sent to the rank which stores its {-x,-y} mirror. */
+    std::vector<std::vector<int>> pencil_send_zcol_;
+
+    /// Local indices of z-columns received back from each xy-rank in the forward pencil transformation.
+    std::vector<std::vector<int>> pencil_send_zcol_fwd_;
+
+    /// Positions of received z-columns inside the local y-line buffer and the conjugation flag.
+    std::vector<std::vector<std::pair<int, bool>>> pencil_recv_zcol_;
+
+    /// Positions of z-columns inside the local y-line buffer which are sent back in the forward transformation.
+    std::vector<std::vector<int>> pencil_recv_zcol_fwd_;
+
+    /// Send buffer of the pencil exchanges.
+    mdarray<complex_t, 1> fft_buffer_pencil_send_;
+
+    /// Receive buffer of the pencil exchanges.
+    mdarray<complex_t, 1> fft_buffer_pencil_recv_;
+
+    /// Buffer of y-lines of the pencil decomposition.
+    mdarray<complex_t, 1> fft_buffer_pencil_y_;
+
+    /// Internal buffers for independent x-transforms.
+    std::vector<complex_t*> fftw_buffer_x_;
+
+    /// Internal buffers for independent y-transforms of the pencil decomposition and of the split xy-transforms.
+    std::vector<complex_t*> fftw_buffer_y_;
+
+    /// FFTW plans for 1D backward x-transformation.
+    std::vector<fftw_plan_t> plan_backward_x_;
+
+    /// FFTW plans for 1D forward x-transformation.
+    std::vector<fftw_plan_t> plan_forward_x_;
+
+    /// FFTW plans for 1D backward y-transformation.
+    std::vector<fftw_plan_t> plan_backward_y_;
+
+    /// FFTW plans for 1D forward y-transformation.
+    std::vector<fftw_plan_t> plan_forward_y_;
+
     /// Main input/output buffer.
     /** This buffer stores the real-space values of the transformed function */
-    mdarray<double_complex, 1> fft_buffer_;
+    mdarray<complex_t, 1> fft_buffer_;
 
     /// Auxiliary array to store z-sticks for all-to-all or GPU.
-    mdarray<double_complex, 1> fft_buffer_aux1_;
+    mdarray<complex_t, 1> fft_buffer_aux1_;
 
     /// Auxiliary array in case of simultaneous transformation of two wave-functions.
-    mdarray<double_complex, 1> fft_buffer_aux2_;
+    mdarray<complex_t, 1> fft_buffer_aux2_;
+
+    /// Auxiliary array to store z-sticks of a batch of functions.
+    mdarray<complex_t, 1> fft_buffer_aux_batch_;
 
-    /// Internal buffer for independent z-transforms.
-    std::vector<double_complex*> fftw_buffer_z_;
+    /// Stage of an asynchronous transformation.
+    enum class async_stage_t
+    {
+        /// Slot is free.
+        idle,
+        /// Exchange of z-sticks is in flight.
+        exchange,
+        /// Whole transformation is deferred to the completion.
+        deferred
+    };
+
+    /// State of an asynchronous transformation.
+    struct async_state_t
+    {
+        /// Stage of the transformation.
+        async_stage_t stage{async_stage_t::idle};
+        /// Direction of the transformation.
+        int direction{0};
+        /// PW coefficients of the transformed function.
+        complex_t* data{nullptr};
+        /// Buffer of z-sticks which is consumed at the completion.
+        complex_t* buf{nullptr};
+        /// Request of the non-blocking exchange.
+        MPI_Request req{MPI_REQUEST_NULL};
+        /// Counts and displacements of the neighborhood exchange; they must stay unchanged while it is in flight.
+        std::vector<int> peer_counts;
+    };
+
+    /// States of the asynchronous transformations; this is the number of transformations in flight.
+    std::array<async_state_t, 2> async_;
+
+    /// Send and receive buffers of z-sticks for each asynchronous transformation.
+    mdarray<complex_t, 2> fft_buffer_async_;
+
+    /// Number of functions in flight in the pipelined application of the local operator.
+    /** Each function passes through the backward z-stage, the fused xy-stage and the forward z-stage; the exchange
+     *  between two stages is in flight while the other functions are processed. */
+    static const int pipeline_depth_{3};
+
+    /// Ring of send and receive buffers of z-sticks of the functions in the pipeline.
+    mdarray<complex_t, 2> fft_buffer_ring_;
+
+    /// Auxiliary array to store the packed z-sticks of a batch of functions for the all-to-all exchange.
+    mdarray<complex_t, 1> fft_buffer_a2a_batch_;
+
+    /// Real-space values of a batch of transformed functions.
+    mdarray<complex_t, 2> fft_buffer_batch_;
+
+    /// Internal buffer for the z-transforms of a block of columns.
+    /** Columns are stored with the stride zcol_stride_. */
+    std::vector<complex_t*> fftw_buffer_z_;
+
+    /// Maximum number of z-columns which fit into L2 cache.
+    int zcol_block_size_max_{1};
+
+    /// Number of z-columns transformed at once.
+    int zcol_block_size_{1};
+
+    /// Distance between two z-columns in the block buffer.
+    /** The size of z-dimension is padded to keep all columns aligned for the 1D plans. */
+    int zcol_stride_{0};
 
     /// Internal buffer for independent {xy}-transforms.
-    std::vector<double_complex*> fftw_buffer_xy_;
+    std::vector<complex_t*> fftw_buffer_xy_;
+
+    /// Internal real-space buffer for independent x-transforms of real functions.
+    std::vector<T*> fftw_buffer_xy_r_;
 
     /// FFTW plan for 1D backward transformation.
-    std::vector<fftw_plan> plan_backward_z_;
+    std::vector<fftw_plan_t> plan_backward_z_;
 
     /// FFTW plan for 2D backward transformation.
-    std::vector<fftw_plan> plan_backward_xy_;
+    std::vector<fftw_plan_t> plan_backward_xy_;
 
     /// FFTW plan for 1D forward transformation.
-    std::vector<fftw_plan> plan_forward_z_;
+    std::vector<fftw_plan_t> plan_forward_z_;
+
+    /// True if short z-columns are transformed with the pruned FFT.
+    /** Set by SDDK_FFT_Z_PRUNING environment variable; pruning is switched off if the value is 0. */
+    bool z_pruning_{true};
+
+    /// Divisors M of size(2) with 2M <= size(2); these are the sizes of the sub-transforms of the pruned FFT.
+    std::vector<int> z_prune_size_;
+
+    /// Twiddle factors exp(2 pi i j / size(2)) of the pruned FFT.
+    std::vector<complex_t> z_twiddle_;
+
+    /// Internal buffers for the pruned z-transforms.
+    std::vector<complex_t*> fftw_buffer_z_pruned_;
+
+    /// Batched FFTW plans of size(2) / M backward transformations of size M for each pruned size and thread.
+    /** Plans are created in prepare() for the pruned sizes which are used by the local z-columns and kept for the
+     *  next partitions; the plans of unused sizes are null. */
+    std::vector<std::vector<fftw_plan_t>> plan_backward_z_pruned_;
+
+    /// Batched FFTW plans of size(2) / M forward transformations of size M for each pruned size and thread.
+    std::vector<std::vector<fftw_plan_t>> plan_forward_z_pruned_;
 
     /// FFTW plan for 2D forward transformation.
-    std::vector<fftw_plan> plan_forward_xy_;
+    std::vector<fftw_plan_t> plan_forward_xy_;
+
+    /// FFTW plan for the backward transformation of a block of z-columns.
+    std::vector<fftw_plan_t> plan_backward_z_block_;
+
+    /// FFTW plan for the forward transformation of a block of z-columns.
+    std::vector<fftw_plan_t> plan_forward_z_block_;
+
+    /// FFTW plan for 1D complex-to-real backward x-transformation.
+    std::vector<fftw_plan_t> plan_backward_x_c2r_;
+
+    /// FFTW plan for 1D real-to-complex forward x-transformation.
+    std::vector<fftw_plan_t> plan_forward_x_r2c_;
+
+    /// FFTW plan for the backward transformation of y-lines touched by z-columns.
+    std::vector<fftw_plan_t> plan_backward_y_lines_;
+
+    /// FFTW plan for the forward transformation of y-lines touched by z-columns.
+    std::vector<fftw_plan_t> plan_forward_y_lines_;
+
+    /// FFTW planner flags.
+    unsigned int fftw_flags_{FFTW_ESTIMATE};
+
+    /// Name of the FFTW wisdom file of this grid; empty if the plans are estimated.
+    std::string fftw_wisdom_file_;
 
     /// True if GPU-direct is enabled.
     bool is_gpu_direct_{false};
@@ -164,19 +909,55 @@ class FFT3D : public FFT3D_grid
     mdarray<char, 1> acc_fft_work_buf_;
 
     /// Mapping of the G-vectors to the FFT buffer for batched 1D transform.
+    /** On the CPU the columns of the buffer are padded to zcol_stride_ elements. */
     mdarray<int, 1> map_gvec_to_fft_buffer_;
 
     /// Mapping of the {0,0,z} G-vectors to the FFT buffer for batched 1D transform in case of reduced G-vector list.
     mdarray<int, 1> map_gvec_to_fft_buffer_x0y0_;
 
+    /// Position of the local G-vectors inside their z-columns.
+    mdarray<int, 1> zcol_gvec_pos_;
+
+    /// Position of the {0,0,-z} G-vectors inside the z-column in case of reduced G-vector list.
+    mdarray<int, 1> zcol_gvec_pos_x0y0_;
+
+    /// Index of the pruned size of the z-transform for each local z-column; -1 for the full transformation.
+    mdarray<int, 1> zcol_prune_idx_;
+
+    /// Prefix sums of the estimated cost of the z-transformation of local z-columns.
+    /** The cost of the column includes the FFT, the repacking of the column and the loading of its G-vectors; it is
+     *  used to split the blocks of columns into balanced tasks. */
+    mdarray<double, 1> zcol_cost_;
+
+    /// Number of tasks per thread in the z-transformation.
+    int const num_zcol_tasks_per_thread_{4};
+
     int const acc_fft_stream_id_{0};
 
     /// Position of z-columns inside 2D FFT buffer.
     mdarray<int, 2> z_col_pos_;
 
+    /// List of x-coordinates touched by z-columns.
+    /** In case of reduced G-vector set only the x-coordinates of the half plane 0 <= x <= size(0) / 2 are stored. */
+    std::vector<int> zcol_x_;
+
+    /// Position of z-columns inside the compact buffer of y-lines.
+    /** Second index is 0 for the {x,y} column and 1 for the {-x,-y} column in case of reduced G-vector set;
+     *  -1 means that the column is not stored in the buffer. */
+    mdarray<int, 2> z_col_pos_y_;
+
     /// Type of the memory for CPU buffers.
     memory_t host_memory_type_;
 
+    /// True if the host buffers are initialized by the threads which work on them.
+    /** With the first-touch page placement of the OS the memory of each buffer then lands on the NUMA domain of
+     *  the threads which use it (threads have to be pinned, e.g. with OMP_PROC_BIND). Set by SDDK_FFT_FIRST_TOUCH
+     *  environment variable; if the value is 0, all buffers are allocated and initialized by the master thread. */
+    bool first_touch_{true};
+
+    /// Memory pool of the main and auxiliary buffers between prepare() and dismiss(); nullptr if the buffers are owned.
+    memory_pool* mem_pool_{nullptr};
+
     /// Maximum number of z-columns ever transformed in case of G-vector transformation.
     /** This is used to recreate the accelerator z-plans when the number of columns has increased */
     int zcol_gvec_count_max_{0};
@@ -191,22 +972,435 @@ class FFT3D : public FFT3D_grid
 
     block_data_descriptor a2a_recv;
 
-    /// Initialize z-transformation and get the maximum number of z-columns.
-    inline int init_plan_z(Gvec_partition const& gvp__, int zcol_count_max__,
-                           void** acc_fft_plan_forward__, void** acc_fft_plan_backward__)
-    {
-        /* check if we need to create a batch cuFFT plan for larger number of z-columns */
-        if (gvp__.zcol_count_fft() > zcol_count_max__) {
-            /* now this is the maximum number of columns */
-            zcol_count_max__ = gvp__.zcol_count_fft();
-            switch (pu_) {
-                case device_t::GPU: {
-                    if (*acc_fft_plan_forward__) {
-#if defined(__CUDA)
-                        cufft::destroy_plan_handle(*acc_fft_plan_forward__);
-#elif defined(__ROCM)
-                        rocfft::destroy_plan_handle(*acc_fft_plan_forward__);
-                        rocfft::destroy_plan_handle(*acc_fft_plan_backward__);
+    /// Compression of the all-to-all payload of z-sticks.
+    a2a_compression_t a2a_compression_{a2a_compression_t::none};
+
+    /// Packed send buffer of the compressed all-to-all exchange.
+    mdarray<char, 1> a2a_packed_send_;
+
+    /// Packed receive buffer of the compressed all-to-all exchange.
+    mdarray<char, 1> a2a_packed_recv_;
+
+    /// True if the z-stick exchange is done with a neighborhood collective over the ranks with non-zero counts.
+    /** Set by SDDK_FFT_A2A_NEIGHBOR environment variable; the plain all-to-all is used if the value is 0. */
+    bool a2a_neighbor_{true};
+
+    /// Value of a2a_neighbor_ at the time the layout of the current G-vector partition was created.
+    bool a2a_neighbor_layout_{false};
+
+    /// Ranks which exchange z-sticks with this rank in any direction.
+    std::vector<int> a2a_peers_;
+
+    /// Graph communicator of the z-stick exchange created in prepare(); the neighbors are a2a_peers_.
+    Communicator a2a_graph_comm_;
+
+    /// Counts and displacements of the neighborhood exchange compacted to the list of peers.
+    std::vector<int> a2a_peer_counts_;
+
+    /// True if the z-sticks of the ranks on the same node are exchanged through the shared memory.
+    /** Set by SDDK_FFT_A2A_SHM environment variable; the shared memory transport is not used if the value is 0. */
+    bool a2a_shm_{true};
+
+    /// Communicator of the FFT ranks on the node of this rank; created in the first call to prepare().
+    Communicator node_comm_;
+
+    /// Rank in the FFT communicator for each rank of the node.
+    std::vector<int> node_ranks_;
+
+    /// Receiving window and receive offsets which this rank publishes for the other ranks of the node.
+    std::unique_ptr<Shared_window<int>> a2a_shm_offsets_;
+
+    /// Shared windows which back the auxiliary buffers and the second buffer of the exchange.
+    std::vector<std::unique_ptr<Shared_window<complex_t>>> a2a_shm_win_;
+
+    /// Segments of the shared windows of all ranks of the node.
+    std::vector<std::vector<complex_t*>> a2a_shm_ptr_;
+
+    /// Segments of the shared receive offsets of all ranks of the node.
+    std::vector<int*> a2a_shm_offsets_ptr_;
+
+    /// Send and receive counts of the inter-node part of the exchange.
+    std::vector<int> a2a_shm_counts_;
+
+    /// Second buffer of z-sticks for the all-to-all exchange on the CPU.
+    /** The exchange reads from one buffer and writes to the other; the two buffers are then swapped, so the
+     *  received z-sticks are consumed in place by the next stage of the transformation. */
+    mdarray<complex_t, 1> fft_buffer_a2a_;
+
+    /// True if the all-to-all exchange on the CPU swaps the buffers instead of copying them.
+    bool a2a_double_buffer_{true};
+
+    /// Number of xy-planes below which each plane is transformed by all threads.
+    /** Set by SDDK_FFT_XY_SPLIT_PLANES environment variable; by default this is the number of threads, so
+     *  that thin slabs in the hybrid MPI+OpenMP mode don't leave threads idle. */
+    int xy_split_planes_{0};
+
+    /// Number of chunks of z-columns in the pipelined z-transformation.
+    /** Set by SDDK_FFT_A2A_CHUNKS environment variable or by a2a_chunks(); pipelining is switched off if the
+     *  value is 1. */
+    int num_a2a_chunks_{1};
+
+    /// Range of local z-columns for each chunk of the pipelined z-transformation.
+    std::vector<std::pair<int, int>> a2a_chunk_zcol_;
+
+    /// Send descriptors of the chunks of z-columns (direction=1).
+    std::vector<block_data_descriptor> a2a_send_chunk_;
+
+    /// Receive descriptors of the chunks of z-columns (direction=1).
+    std::vector<block_data_descriptor> a2a_recv_chunk_;
+
+    /// Layout of the FFT for a given G-vector partition.
+    /** This is the part of the state which is created in prepare() and depends on the G-vector partition. */
+    struct layout_t
+    {
+        /// Identifier of the G-vector partition.
+        size_t gvec_partition_id;
+
+        block_data_descriptor a2a_send;
+        block_data_descriptor a2a_recv;
+        std::vector<std::pair<int, int>> a2a_chunk_zcol;
+        std::vector<block_data_descriptor> a2a_send_chunk;
+        std::vector<block_data_descriptor> a2a_recv_chunk;
+        bool a2a_neighbor{false};
+        std::vector<int> a2a_peers;
+        Communicator a2a_graph_comm;
+        mdarray<int, 2> z_col_pos;
+        std::vector<std::vector<int>> pencil_send_zcol;
+        std::vector<std::vector<int>> pencil_send_zcol_fwd;
+        std::vector<std::vector<std::pair<int, bool>>> pencil_recv_zcol;
+        std::vector<std::vector<int>> pencil_recv_zcol_fwd;
+        std::vector<int> zcol_x;
+        mdarray<int, 2> z_col_pos_y;
+        std::vector<fftw_plan_t> plan_backward_y_lines;
+        std::vector<fftw_plan_t> plan_forward_y_lines;
+        int zcol_block_size{1};
+        std::vector<fftw_plan_t> plan_backward_z_block;
+        std::vector<fftw_plan_t> plan_forward_z_block;
+        mdarray<int, 1> zcol_gvec_pos;
+        mdarray<int, 1> zcol_gvec_pos_x0y0;
+        mdarray<int, 1> zcol_prune_idx;
+        mdarray<double, 1> zcol_cost;
+        mdarray<int, 1> map_gvec_to_fft_buffer;
+        mdarray<int, 1> map_gvec_to_fft_buffer_x0y0;
+    };
+
+    /// Cache of the layouts of recently dismissed G-vector partitions; the most recently used goes first.
+    std::list<layout_t> layout_cache_;
+
+    /// Maximum number of cached layouts.
+    /** Set by SDDK_FFT_LAYOUT_CACHE_SIZE environment variable; caching is switched off if the value is 0. */
+    int layout_cache_size_{64};
+
+    /// Pack a block of complex numbers into a lossy format.
+    /** The block starts with the scale factor stored as double, followed by the real and imaginary parts
+     *  converted to the type I. For the integer types the values are scaled such that the largest component
+     *  of the block is mapped to the largest integer. */
+    template <typename I>
+    static void pack_a2a_block(complex_t const* in__, int n__, char* out__)
+    {
+        double scale{1};
+        if (std::is_integral<I>::value) {
+            double vmax{0};
+            for (int i = 0; i < n__; i++) {
+                vmax = std::max(vmax, static_cast<double>(std::max(std::abs(in__[i].real()),
+                                                                   std::abs(in__[i].imag()))));
+            }
+            if (vmax > 0) {
+                scale = vmax / std::numeric_limits<I>::max();
+            }
+        }
+        std::memcpy(out__, &scale, sizeof(double));
+        auto ptr = reinterpret_cast<I*>(out__ + sizeof(double));
+        for (int i = 0; i < n__; i++) {
+            double re = in__[i].real() / scale;
+            double im = in__[i].imag() / scale;
+            ptr[2 * i]     = static_cast<I>(std::is_integral<I>::value ? std::round(re) : re);
+            ptr[2 * i + 1] = static_cast<I>(std::is_integral<I>::value ? std::round(im) : im);
+        }
+    }
+
+    /// Unpack a block of complex numbers.
+    template <typename I>
+    static void unpack_a2a_block(char const* in__, int n__, complex_t* out__)
+    {
+        double scale;
+        std::memcpy(&scale, in__, sizeof(double));
+        auto ptr = reinterpret_cast<I const*>(in__ + sizeof(double));
+        for (int i = 0; i < n__; i++) {
+            out__[i] = complex_t(ptr[2 * i] * scale, ptr[2 * i + 1] * scale);
+        }
+    }
+
+    /// All-to-all exchange with a compressed payload.
+    template <typename I>
+    void alltoall_compressed(complex_t* sendbuf__, int const* sendcounts__, int const* sdispls__, complex_t* recvbuf__,
+                             int const* recvcounts__, int const* rdispls__)
+    {
+        PROFILE("sddk::FFT3D::alltoall_compressed");
+
+        /* size of a packed block of n values */
+        auto packed_size = [](int n) { return static_cast<int>(sizeof(double) + 2 * n * sizeof(I)); };
+
+        block_data_descriptor send(comm_.size());
+        block_data_descriptor recv(comm_.size());
+        for (int r = 0; r < comm_.size(); r++) {
+            send.counts[r] = packed_size(sendcounts__[r]);
+            recv.counts[r] = packed_size(recvcounts__[r]);
+        }
+        send.calc_offsets();
+        recv.calc_offsets();
+
+        size_t send_size = send.offsets.back() + send.counts.back();
+        size_t recv_size = recv.offsets.back() + recv.counts.back();
+        if (a2a_packed_send_.size() < send_size) {
+            a2a_packed_send_ = allocate_work_array<char, 1>(memory_t::host, "FFT3D.a2a_packed_send_", send_size);
+        }
+        if (a2a_packed_recv_.size() < recv_size) {
+            a2a_packed_recv_ = allocate_work_array<char, 1>(memory_t::host, "FFT3D.a2a_packed_recv_", recv_size);
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < comm_.size(); r++) {
+            pack_a2a_block<I>(&sendbuf__[sdispls__[r]], sendcounts__[r], &a2a_packed_send_[send.offsets[r]]);
+        }
+
+        comm_.alltoall(a2a_packed_send_.at(memory_t::host), send.counts.data(), send.offsets.data(),
+                       a2a_packed_recv_.at(memory_t::host), recv.counts.data(), recv.offsets.data());
+
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < comm_.size(); r++) {
+            unpack_a2a_block<I>(&a2a_packed_recv_[recv.offsets[r]], recvcounts__[r], &recvbuf__[rdispls__[r]]);
+        }
+    }
+
+    /// Compact counts and displacements of all ranks of the FFT communicator to the list of peers.
+    /** The send counts, send displacements, receive counts and receive displacements of the peers are stored one
+     *  after another in peer_counts. */
+    void compact_a2a_peer_counts(int const* sendcounts__, int const* sdispls__, int const* recvcounts__,
+                                 int const* rdispls__, std::vector<int>& peer_counts__) const
+    {
+        int n = static_cast<int>(a2a_peers_.size());
+
+        peer_counts__.resize(4 * n);
+        for (int i = 0; i < n; i++) {
+            int r = a2a_peers_[i];
+            peer_counts__[i]         = sendcounts__[r];
+            peer_counts__[n + i]     = sdispls__[r];
+            peer_counts__[2 * n + i] = recvcounts__[r];
+            peer_counts__[3 * n + i] = rdispls__[r];
+        }
+    }
+
+    /// Exchange of z-sticks with the neighborhood collective over the peers of this rank.
+    /** Counts and displacements are given for all ranks of the FFT communicator as in the plain all-to-all. */
+    void alltoall_neighbor(complex_t* sendbuf__, int const* sendcounts__, int const* sdispls__, complex_t* recvbuf__,
+                           int const* recvcounts__, int const* rdispls__)
+    {
+        int n = static_cast<int>(a2a_peers_.size());
+
+        compact_a2a_peer_counts(sendcounts__, sdispls__, recvcounts__, rdispls__, a2a_peer_counts_);
+        auto c = a2a_peer_counts_.data();
+        a2a_graph_comm_.neighbor_alltoall(sendbuf__, c, c + n, recvbuf__, c + 2 * n, c + 3 * n);
+    }
+
+    /// Check if the shared memory transport is used for the exchange of z-sticks.
+    inline bool use_a2a_shm() const
+    {
+        return a2a_shm_ && pu_ == device_t::CPU && comm_.size() > 1 && num_ranks_xy_ == 1;
+    }
+
+    /// Index of the shared window of a receiving buffer or -1 if the buffer is not shared.
+    inline int a2a_shm_window(complex_t const* recvbuf__) const
+    {
+        for (int i = 0; i < static_cast<int>(a2a_shm_win_.size()); i++) {
+            if (a2a_shm_win_[i]->at() == recvbuf__) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /// Create the node communicator and the table of receive offsets of the shared memory transport.
+    void init_a2a_shm()
+    {
+        node_comm_ = comm_.split_shared();
+
+        node_ranks_ = std::vector<int>(node_comm_.size());
+        node_ranks_[node_comm_.rank()] = comm_.rank();
+        node_comm_.allgather(node_ranks_.data(), node_comm_.rank(), 1);
+
+        /* index of the receiving window followed by the receive offsets for each rank of the node */
+        a2a_shm_offsets_ = std::unique_ptr<Shared_window<int>>(new Shared_window<int>(node_comm_, node_comm_.size() + 1));
+        a2a_shm_offsets_ptr_.resize(node_comm_.size());
+        for (int i = 0; i < node_comm_.size(); i++) {
+            a2a_shm_offsets_ptr_[i] = a2a_shm_offsets_->at(i);
+        }
+    }
+
+    /// Reallocate auxiliary buffers in the shared windows of the node.
+    /** The windows are reallocated on all ranks of the node if any of them needs larger buffers. */
+    void reallocate_fft_buffer_shm()
+    {
+        if (node_comm_.mpi_comm() == MPI_COMM_NULL) {
+            init_a2a_shm();
+        }
+
+        size_t sz_max = fft_buffer_aux_size();
+        /* buffers are empty if they were taken from a memory pool in the previous call */
+        int realloc = (a2a_shm_win_.empty() || sz_max > a2a_shm_win_[0]->size() || !fft_buffer_aux1_.size()) ? 1 : 0;
+        node_comm_.allreduce<int, mpi_op_t::max>(&realloc, 1);
+        if (!realloc) {
+            return;
+        }
+        if (!a2a_shm_win_.empty()) {
+            sz_max = std::max(sz_max, a2a_shm_win_[0]->size());
+        }
+        /* release the old windows first */
+        a2a_shm_win_.clear();
+        for (int i = 0; i < 3; i++) {
+            a2a_shm_win_.emplace_back(new Shared_window<complex_t>(node_comm_, sz_max));
+            first_touch(a2a_shm_win_[i]->at(), sz_max);
+        }
+        a2a_shm_ptr_ = std::vector<std::vector<complex_t*>>(3, std::vector<complex_t*>(node_comm_.size()));
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < node_comm_.size(); j++) {
+                a2a_shm_ptr_[i][j] = a2a_shm_win_[i]->at(j);
+            }
+        }
+        fft_buffer_aux1_ = mdarray<complex_t, 1>(a2a_shm_win_[0]->at(), sz_max, "fft_buffer_aux1_");
+        fft_buffer_aux2_ = mdarray<complex_t, 1>(a2a_shm_win_[1]->at(), sz_max, "fft_buffer_aux2_");
+        fft_buffer_a2a_  = mdarray<complex_t, 1>(a2a_shm_win_[2]->at(), sz_max, "fft_buffer_a2a_");
+    }
+
+    /// Synchronize the shared windows between the ranks of the node.
+    inline void a2a_shm_barrier()
+    {
+        a2a_shm_offsets_->sync();
+        for (auto& w : a2a_shm_win_) {
+            w->sync();
+        }
+        node_comm_.barrier();
+        a2a_shm_offsets_->sync();
+        for (auto& w : a2a_shm_win_) {
+            w->sync();
+        }
+    }
+
+    /// Exchange of z-sticks with the shared memory transport between the ranks of the node.
+    /** Each rank publishes its receiving window and receive offsets; the ranks of the same node then store their
+     *  sticks directly in the receiving buffers of the peers, while the blocks of the ranks on the other nodes are
+     *  exchanged with a non-blocking all-to-all in the meantime. */
+    void alltoall_shm(complex_t* sendbuf__, int const* sendcounts__, int const* sdispls__, complex_t* recvbuf__,
+                      int const* recvcounts__, int const* rdispls__)
+    {
+        int nn = node_comm_.size();
+
+        auto offs = a2a_shm_offsets_->at();
+        offs[0] = a2a_shm_window(recvbuf__);
+        for (int i = 0; i < nn; i++) {
+            offs[i + 1] = rdispls__[node_ranks_[i]];
+        }
+
+        /* counts of the ranks on the other nodes */
+        a2a_shm_counts_.resize(2 * comm_.size());
+        auto sc = &a2a_shm_counts_[0];
+        auto rc = &a2a_shm_counts_[comm_.size()];
+        std::copy(sendcounts__, sendcounts__ + comm_.size(), sc);
+        std::copy(recvcounts__, recvcounts__ + comm_.size(), rc);
+        for (int i = 0; i < nn; i++) {
+            sc[node_ranks_[i]] = 0;
+            rc[node_ranks_[i]] = 0;
+        }
+        bool inter_node = (nn < comm_.size());
+
+        MPI_Request req;
+        if (inter_node) {
+            comm_.ialltoall(sendbuf__, sc, sdispls__, recvbuf__, rc, rdispls__, &req);
+        }
+
+        /* receiving buffers of the node are free and their offsets are published */
+        a2a_shm_barrier();
+
+        int r = node_comm_.rank();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < nn; i++) {
+            /* start from the next rank, so that the ranks don't store into the same segment at the same time */
+            int j  = (r + i) % nn;
+            int rj = node_ranks_[j];
+            if (sendcounts__[rj]) {
+                auto ptr = a2a_shm_ptr_[a2a_shm_offsets_ptr_[j][0]][j] + a2a_shm_offsets_ptr_[j][r + 1];
+                std::copy(sendbuf__ + sdispls__[rj], sendbuf__ + sdispls__[rj] + sendcounts__[rj], ptr);
+            }
+        }
+
+        /* all blocks of the node are stored */
+        a2a_shm_barrier();
+
+        if (inter_node) {
+            CALL_MPI(MPI_Wait, (&req, MPI_STATUS_IGNORE));
+        }
+    }
+
+    /// All-to-all exchange of z-sticks.
+    /** The payload is compressed according to a2a_compression_ if the buffers are in the host memory. */
+    void alltoall_z(complex_t* sendbuf__, int const* sendcounts__, int const* sdispls__, complex_t* recvbuf__,
+                    int const* recvcounts__, int const* rdispls__, memory_t mem__ = memory_t::host)
+    {
+        if (is_device_memory(mem__)) {
+            comm_.alltoall(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__, rdispls__);
+            return;
+        }
+        switch (a2a_compression_) {
+            case a2a_compression_t::none: {
+                if (use_a2a_shm() && a2a_shm_window(recvbuf__) >= 0) {
+                    alltoall_shm(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__, rdispls__);
+                } else if (a2a_graph_comm_.mpi_comm() != MPI_COMM_NULL) {
+                    alltoall_neighbor(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__, rdispls__);
+                } else {
+                    comm_.alltoall(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__, rdispls__);
+                }
+                break;
+            }
+            case a2a_compression_t::single: {
+                alltoall_compressed<float>(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__, rdispls__);
+                break;
+            }
+            case a2a_compression_t::fixed16: {
+                alltoall_compressed<int16_t>(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__,
+                                             rdispls__);
+                break;
+            }
+            case a2a_compression_t::fixed8: {
+                alltoall_compressed<int8_t>(sendbuf__, sendcounts__, sdispls__, recvbuf__, recvcounts__,
+                                            rdispls__);
+                break;
+            }
+        }
+    }
+
+    /// Cast the pointer to the type of the accelerator kernels.
+    /** Accelerator backend works only in double precision; this is checked in the constructor. */
+    static double_complex* acc_ptr(complex_t* ptr__)
+    {
+        return reinterpret_cast<double_complex*>(ptr__);
+    }
+
+    /// Initialize z-transformation and get the maximum number of z-columns.
+    inline int init_plan_z(Gvec_partition const& gvp__, int zcol_count_max__,
+                           void** acc_fft_plan_forward__, void** acc_fft_plan_backward__)
+    {
+        /* check if we need to create a batch cuFFT plan for larger number of z-columns */
+        if (gvp__.zcol_count_fft() > zcol_count_max__) {
+            /* now this is the maximum number of columns */
+            zcol_count_max__ = gvp__.zcol_count_fft();
+            switch (pu_) {
+                case device_t::GPU: {
+                    if (*acc_fft_plan_forward__) {
+#if defined(__CUDA)
+                        cufft::destroy_plan_handle(*acc_fft_plan_forward__);
+#elif defined(__ROCM)
+                        rocfft::destroy_plan_handle(*acc_fft_plan_forward__);
+                        rocfft::destroy_plan_handle(*acc_fft_plan_backward__);
 #endif
                     }
 #if defined(__CUDA) || defined(__ROCM)
@@ -233,8 +1427,82 @@ class FFT3D : public FFT3D_grid
         return zcol_count_max__;
     }
 
-    /// Reallocate auxiliary buffer.
-    inline void reallocate_fft_buffer_aux(mdarray<double_complex, 1>& fft_buffer_aux__)
+    /// Initialize a host buffer with a static distribution of elements between threads.
+    /** The access pattern of auxiliary buffers is not fixed, so the pages are only spread between the NUMA domains
+     *  of all threads instead of being placed on the domain of the master thread. */
+    void first_touch(complex_t* ptr__, size_t n__) const
+    {
+        if (!first_touch_) {
+            return;
+        }
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n__; i++) {
+            ptr__[i] = 0;
+        }
+    }
+
+    /// Allocate FFTW buffers of a single thread.
+    void allocate_thread_buffers(int tid__)
+    {
+        fftw_buffer_z_[tid__] = (complex_t*)fftw_t::malloc(zcol_block_size_max_ * zcol_stride_ * sizeof(complex_t));
+        fftw_buffer_xy_[tid__]       = (complex_t*)fftw_t::malloc(size(0) * size(1) * sizeof(complex_t));
+        fftw_buffer_x_[tid__]        = (complex_t*)fftw_t::malloc(size(0) * sizeof(complex_t));
+        fftw_buffer_xy_r_[tid__]     = (T*)fftw_t::malloc(size(0) * sizeof(T));
+        fftw_buffer_y_[tid__]        = (complex_t*)fftw_t::malloc(size(1) * sizeof(complex_t));
+        fftw_buffer_z_pruned_[tid__] = (complex_t*)fftw_t::malloc(size(2) * sizeof(complex_t));
+
+        /* touch the pages */
+        std::fill(fftw_buffer_z_[tid__], fftw_buffer_z_[tid__] + zcol_block_size_max_ * zcol_stride_, 0);
+        std::fill(fftw_buffer_xy_[tid__], fftw_buffer_xy_[tid__] + size(0) * size(1), 0);
+        std::fill(fftw_buffer_x_[tid__], fftw_buffer_x_[tid__] + size(0), 0);
+        std::fill(fftw_buffer_xy_r_[tid__], fftw_buffer_xy_r_[tid__] + size(0), 0);
+        std::fill(fftw_buffer_y_[tid__], fftw_buffer_y_[tid__] + size(1), 0);
+        std::fill(fftw_buffer_z_pruned_[tid__], fftw_buffer_z_pruned_[tid__] + size(2), 0);
+    }
+
+    /// Allocate the main FFT buffer in the host memory or in the memory pool.
+    inline void allocate_fft_buffer()
+    {
+        if (mem_pool_) {
+            fft_buffer_ = mdarray<complex_t, 1>(*mem_pool_, local_size(), "FFT3D.fft_buffer_");
+        } else {
+            fft_buffer_ = mdarray<complex_t, 1>(local_size(), host_memory_type_, "FFT3D.fft_buffer_");
+        }
+        if (first_touch_) {
+            /* same distribution of xy-planes between threads as in transform_xy_cpu() */
+            int size_xy = local_size() / std::max(1, local_size_z());
+            #pragma omp parallel for schedule(static)
+            for (int iz = 0; iz < local_size_z(); iz++) {
+                std::fill(&fft_buffer_[iz * size_xy], &fft_buffer_[iz * size_xy] + size_xy, 0);
+            }
+        }
+    }
+
+    /// Allocate a host work array from the memory pool, if it is set, or in the memory of the given type.
+    template <typename U, int N, typename... D>
+    inline mdarray<U, N> allocate_work_array(memory_t mem__, std::string label__, D... dims__)
+    {
+        if (mem_pool_) {
+            return mdarray<U, N>(*mem_pool_, static_cast<size_t>(dims__)..., label__);
+        }
+        return mdarray<U, N>(static_cast<size_t>(dims__)..., mem__, label__);
+    }
+
+    /// Allocate the auxiliary buffers from the memory pool with the size required by the current partition.
+    inline void allocate_fft_buffer_aux_pool()
+    {
+        size_t sz = fft_buffer_aux_size();
+        for (auto buf : {&fft_buffer_aux1_, &fft_buffer_aux2_, &fft_buffer_a2a_}) {
+            if (buf == &fft_buffer_a2a_ && comm_.size() == 1) {
+                continue;
+            }
+            *buf = mdarray<complex_t, 1>(*mem_pool_, sz, "fft_buffer_aux_");
+            first_touch(buf->at(memory_t::host), sz);
+        }
+    }
+
+    /// Size of the auxiliary buffer for the current G-vector partition.
+    inline size_t fft_buffer_aux_size() const
     {
         int zcol_count_max{0};
         if (gvec_partition_->gvec().bare()) {
@@ -243,15 +1511,455 @@ class FFT3D : public FFT3D_grid
             zcol_count_max = zcol_gkvec_count_max_;
         }
 
-        size_t sz_max = std::max(size(2) * zcol_count_max, local_size_z() * gvec_partition_->gvec().num_zcol());
+        return std::max(size(2) * zcol_count_max, local_size_z() * gvec_partition_->gvec().num_zcol());
+    }
+
+    /// Reallocate auxiliary buffer.
+    inline void reallocate_fft_buffer_aux(mdarray<complex_t, 1>& fft_buffer_aux__)
+    {
+        size_t sz_max = fft_buffer_aux_size();
         if (sz_max > fft_buffer_aux__.size()) {
-            fft_buffer_aux__ = mdarray<double_complex, 1>(sz_max, host_memory_type_, "fft_buffer_aux_");
+            fft_buffer_aux__ = mdarray<complex_t, 1>(sz_max, host_memory_type_, "fft_buffer_aux_");
+            first_touch(fft_buffer_aux__.at(memory_t::host), sz_max);
             if (pu_ == device_t::GPU) {
                 fft_buffer_aux__.allocate(memory_t::device);
             }
         }
     }
 
+    /// Reallocate auxiliary buffers of a batch of functions.
+    inline void reallocate_fft_buffer_aux_batch(int num_fft__)
+    {
+        /* full stick size times local number of z-columns */
+        size_t z_sticks_size = static_cast<size_t>(gvec_partition_->zcol_count_fft()) * size(2);
+        /* local stick size times full number of z-columns */
+        size_t a2a_size = static_cast<size_t>(gvec_partition_->gvec().num_zcol()) * local_size_z();
+
+        size_t sz = std::max(z_sticks_size, a2a_size) * num_fft__;
+        if (fft_buffer_aux_batch_.size() < sz) {
+            fft_buffer_aux_batch_ =
+                allocate_work_array<complex_t, 1>(host_memory_type_, "FFT3D.fft_buffer_aux_batch_", sz);
+            first_touch(fft_buffer_aux_batch_.at(memory_t::host), sz);
+        }
+        if (comm_.size() > 1 && fft_buffer_a2a_batch_.size() < sz) {
+            fft_buffer_a2a_batch_ =
+                allocate_work_array<complex_t, 1>(host_memory_type_, "FFT3D.fft_buffer_a2a_batch_", sz);
+            first_touch(fft_buffer_a2a_batch_.at(memory_t::host), sz);
+        }
+    }
+
+    /// Transformation of z-columns of a batch of functions on the CPU.
+    /** The z-sticks of all functions are exchanged in a single all-to-all call. The local fractions of z-columns of
+     *  the function i are stored in fft_buffer_aux_batch_ at the offset i * num_zcol * local_size_z. */
+    template <int direction>
+    void transform_z_batch(std::vector<complex_t*> const& data__)
+    {
+        int num_fft = static_cast<int>(data__.size());
+
+        /* local stick size times full number of z-columns */
+        size_t a2a_size = static_cast<size_t>(gvec_partition_->gvec().num_zcol()) * local_size_z();
+
+        /* counts and offsets of the packed all-to-all exchange */
+        block_data_descriptor send(comm_.size());
+        block_data_descriptor recv(comm_.size());
+        for (int r = 0; r < comm_.size(); r++) {
+            send.counts[r] = num_fft * a2a_send.counts[r];
+            recv.counts[r] = num_fft * a2a_recv.counts[r];
+        }
+        send.calc_offsets();
+        recv.calc_offsets();
+
+        auto aux = fft_buffer_aux_batch_.at(memory_t::host);
+
+        switch (direction) {
+            case 1: {
+                transform_z_serial_cpu<direction>(num_fft, data__.data(), aux);
+
+                if (comm_.size() > 1) {
+                    utils::timer t("sddk::FFT3D::transform_batch|comm");
+
+                    auto a2a = fft_buffer_a2a_batch_.at(memory_t::host);
+
+                    alltoall_z(aux, send.counts.data(), send.offsets.data(), a2a, recv.counts.data(),
+                               recv.offsets.data());
+
+                    /* unpack z-sticks of each function */
+                    #pragma omp parallel for schedule(static)
+                    for (int i = 0; i < num_fft; i++) {
+                        for (int r = 0; r < comm_.size(); r++) {
+                            auto ptr = &a2a[recv.offsets[r] + i * a2a_recv.counts[r]];
+                            std::copy(ptr, ptr + a2a_recv.counts[r], &aux[i * a2a_size + a2a_recv.offsets[r]]);
+                        }
+                    }
+                }
+                break;
+            }
+            case -1: {
+                if (comm_.size() > 1) {
+                    utils::timer t("sddk::FFT3D::transform_batch|comm");
+
+                    auto a2a = fft_buffer_a2a_batch_.at(memory_t::host);
+
+                    /* pack z-sticks of each function */
+                    #pragma omp parallel for schedule(static)
+                    for (int i = 0; i < num_fft; i++) {
+                        for (int r = 0; r < comm_.size(); r++) {
+                            auto ptr = &aux[i * a2a_size + a2a_recv.offsets[r]];
+                            std::copy(ptr, ptr + a2a_recv.counts[r], &a2a[recv.offsets[r] + i * a2a_recv.counts[r]]);
+                        }
+                    }
+
+                    alltoall_z(a2a, recv.counts.data(), recv.offsets.data(), aux, send.counts.data(),
+                               send.offsets.data());
+                }
+
+                transform_z_serial_cpu<direction>(num_fft, data__.data(), aux);
+                break;
+            }
+            default: {
+                TERMINATE("wrong direction");
+            }
+        }
+    }
+
+    /// Backward transformation of a z-column with the G-vectors in a short range of z-frequencies.
+    /** The size of the column is split as N = L M and the output index as k = L k_2 + k_1. Then
+     *  \f[
+     *    y(L k_2 + k_1) = \sum_{m=0}^{M-1} e^{2 \pi i m k_2 / M} \sum_{n \equiv m \pmod{M}}
+     *      x(n) e^{2 \pi i n k_1 / N}
+     *  \f]
+     *  i.e. L transformations of size M of the twiddled input. The buffer of the L sub-blocks is zeroed and each
+     *  of the ngv non-zero input elements is added to all sub-blocks with its twiddle factors, which costs O(ngv L);
+     *  all L transformations of size M are then executed. The total work O(ngv L + N log M) is smaller than the
+     *  O(N log N) of the full transformation for short columns. The full column of the size(2) elements is
+     *  written to col.
+     */
+    void transform_z_pruned_backward(int idx__, int tid__, int ngv__, int const* pos__, complex_t const* data__,
+                                     complex_t* col__)
+    {
+        int N = size(2);
+        int M = z_prune_size_[idx__];
+        int L = N / M;
+
+        auto buf = fftw_buffer_z_pruned_[tid__];
+
+        std::fill(buf, buf + N, 0);
+        for (int j = 0; j < ngv__; j++) {
+            int n  = pos__[j];
+            int m  = n % M;
+            auto z = data__[j];
+            /* index of the twiddle factor n * k1 mod N */
+            int t{0};
+            for (int k1 = 0; k1 < L; k1++) {
+                buf[k1 * M + m] += z * z_twiddle_[t];
+                t += n;
+                if (t >= N) {
+                    t -= N;
+                }
+            }
+        }
+
+        fftw_t::execute(plan_backward_z_pruned_[tid__][idx__]);
+
+        for (int k1 = 0; k1 < L; k1++) {
+            for (int k2 = 0; k2 < M; k2++) {
+                col__[L * k2 + k1] = buf[k1 * M + k2];
+            }
+        }
+    }
+
+    /// Forward transformation of a z-column with the output only in a short range of z-frequencies.
+    /** This is the transpose of transform_z_pruned_backward(): L transformations of size M of the strided input
+     *  are followed by the twiddled summation for the ngv requested output elements, which are scaled by norm. */
+    void transform_z_pruned_forward(int idx__, int tid__, int ngv__, int const* pos__, complex_t const* col__,
+                                    complex_t* data__, T norm__)
+    {
+        int N = size(2);
+        int M = z_prune_size_[idx__];
+        int L = N / M;
+
+        auto buf = fftw_buffer_z_pruned_[tid__];
+
+        for (int k1 = 0; k1 < L; k1++) {
+            for (int k2 = 0; k2 < M; k2++) {
+                buf[k1 * M + k2] = col__[L * k2 + k1];
+            }
+        }
+
+        fftw_t::execute(plan_forward_z_pruned_[tid__][idx__]);
+
+        for (int j = 0; j < ngv__; j++) {
+            int n = pos__[j];
+            int m = n % M;
+            complex_t z(0, 0);
+            int t{0};
+            for (int k1 = 0; k1 < L; k1++) {
+                z += std::conj(z_twiddle_[t]) * buf[k1 * M + m];
+                t += n;
+                if (t >= N) {
+                    t -= N;
+                }
+            }
+            data__[j] = z * norm__;
+        }
+    }
+
+    /// Scatter the PW coefficients of a block of z-columns into the z-buffer with the flat index map.
+    /** The index map points to the positions inside the buffer of all local columns; the block of columns starts at
+     *  the position base. Real and imaginary parts are moved separately, so the loop is vectorized with the scatter
+     *  instructions where they are available. */
+    static void load_zcol_block(int n__, int const* map__, int base__, complex_t const* data__, complex_t* zbuf__)
+    {
+        auto src = reinterpret_cast<T const*>(data__);
+        auto dst = reinterpret_cast<T*>(zbuf__);
+        #pragma omp simd
+        for (int j = 0; j < n__; j++) {
+            int p      = 2 * (map__[j] - base__);
+            dst[p]     = src[2 * j];
+            dst[p + 1] = src[2 * j + 1];
+        }
+    }
+
+    /// Gather the PW coefficients of a block of z-columns from the z-buffer and apply the normalization.
+    static void unload_zcol_block(int n__, int const* map__, int base__, complex_t const* zbuf__, complex_t* data__,
+                                  T norm__)
+    {
+        auto src = reinterpret_cast<T const*>(zbuf__);
+        auto dst = reinterpret_cast<T*>(data__);
+        #pragma omp simd
+        for (int j = 0; j < n__; j++) {
+            int p          = 2 * (map__[j] - base__);
+            dst[2 * j]     = src[p] * norm__;
+            dst[2 * j + 1] = src[p + 1] * norm__;
+        }
+    }
+
+    /// Serial part of 1D transformation of columns for a batch of functions on the CPU.
+    /** The z-sticks of all functions are stored in fft_buffer_aux in a packed form, ready for a single mpi_a2a:
+     *  the block of data destined to (or received from) the rank r starts at num_fft * a2a_send.offsets[r] and
+     *  the block of the function ifft is located at the offset ifft * a2a_send.counts[r] inside it. For a single
+     *  function this is exactly the layout of the non-batched transformation.
+     *
+     *  Columns are transformed in blocks of zcol_block_size_ with a single batched FFTW plan; the block size
+     *  is chosen in prepare_z_blocks(). Incomplete blocks are transformed column by column in the same buffer.
+     *  If the block contains short columns and pruning is switched on, the block is also transformed column by
+     *  column and short columns are transformed with the pruned FFT.
+     *
+     *  Consecutive blocks are grouped into tasks of about the same estimated cost (see zcol_cost_); each thread
+     *  starts with its own range of tasks and steals tasks of the other threads when its range is exhausted.
+     */
+    template <int direction>
+    void transform_z_serial_cpu(int num_fft__, complex_t* const* data__, complex_t* fft_buffer_aux__,
+                                int icol_begin__ = 0, int icol_end__ = -1)
+    {
+        utils::timer t("sddk::FFT3D::transform_z_serial|cpu");
+
+        if (icol_end__ < 0) {
+            icol_end__ = gvec_partition_->zcol_count_fft();
+        }
+
+        /* local number of z-columns to transform */
+        int num_zcol_local = icol_end__ - icol_begin__;
+
+        /* number of blocks of columns for each function */
+        int num_blocks = (num_zcol_local + zcol_block_size_ - 1) / zcol_block_size_;
+
+        T norm = 1.0 / size();
+
+        bool is_reduced = gvec_partition_->gvec().reduced();
+
+        int num_zcol = gvec_partition_->zcol_count_fft();
+
+        auto transform_block = [&](int k, int tid) {
+            /* index of the function */
+            int ifft = k / num_blocks;
+            /* first local column of the block */
+            int i0 = icol_begin__ + (k % num_blocks) * zcol_block_size_;
+            /* number of columns in the block */
+            int ncol = std::min(zcol_block_size_, icol_end__ - i0);
+
+            complex_t* data = data__[ifft];
+
+            auto zbuf = fftw_buffer_z_[tid];
+
+            /* G-vectors of the block of local columns are stored contiguously */
+            int g0 = gvec_partition_->zcol_offs(gvec_partition_->idx_zcol<index_domain_t::local>(i0));
+            int g1 = (i0 + ncol < num_zcol) ?
+                     gvec_partition_->zcol_offs(gvec_partition_->idx_zcol<index_domain_t::local>(i0 + ncol)) :
+                     gvec_partition_->gvec_count_fft();
+
+            /* check if the block has columns for the pruned transformation */
+            bool is_pruned{false};
+            if (z_pruning_) {
+                for (int i = 0; i < ncol; i++) {
+                    if (zcol_prune_idx_[i0 + i] >= 0) {
+                        is_pruned = true;
+                    }
+                }
+            }
+
+            switch (direction) {
+                case 1: {
+                    /* clear z buffer */
+                    std::fill(zbuf, zbuf + ncol * zcol_stride_, 0);
+                    /* load z columns of PW coefficients into buffer; in the block with pruned columns the
+                       consecutive full columns are loaded together and the pruned columns are transformed */
+                    int ga{g0};
+                    for (int i = 0; i < ncol && is_pruned; i++) {
+                        if (zcol_prune_idx_[i0 + i] < 0) {
+                            continue;
+                        }
+                        int icol        = gvec_partition_->idx_zcol<index_domain_t::local>(i0 + i);
+                        int data_offset = gvec_partition_->zcol_offs(icol);
+                        int ngv         = static_cast<int>(gvec_partition_->gvec().zcol(icol).z.size());
+
+                        load_zcol_block(data_offset - ga, &map_gvec_to_fft_buffer_[ga], i0 * zcol_stride_, &data[ga],
+                                        zbuf);
+                        transform_z_pruned_backward(zcol_prune_idx_[i0 + i], tid, ngv, &zcol_gvec_pos_[data_offset],
+                                                    &data[data_offset], &zbuf[i * zcol_stride_]);
+                        ga = data_offset + ngv;
+                    }
+                    load_zcol_block(g1 - ga, &map_gvec_to_fft_buffer_[ga], i0 * zcol_stride_, &data[ga], zbuf);
+
+                    /* the {0,0,-z} part of the reduced column is loaded separately */
+                    for (int i = 0; i < ncol && is_reduced; i++) {
+                        /* global index of column */
+                        int icol = gvec_partition_->idx_zcol<index_domain_t::local>(i0 + i);
+                        /* offset of the PW coeffs in the input/output data buffer */
+                        int data_offset = gvec_partition_->zcol_offs(icol);
+                        int ngv         = static_cast<int>(gvec_partition_->gvec().zcol(icol).z.size());
+
+                        auto col = &zbuf[i * zcol_stride_];
+
+                        /* column with {x,y} = {0,0} has only non-negative z components */
+                        if (!icol) {
+                            /* load remaining part of {0,0,z} column */
+                            for (int j = 0; j < ngv; j++) {
+                                col[zcol_gvec_pos_x0y0_[j]] = std::conj(data[data_offset + j]);
+                            }
+                        }
+                    }
+
+                    /* perform local FFT transform of columns */
+                    if (ncol == zcol_block_size_ && !is_pruned) {
+                        fftw_t::execute(plan_backward_z_block_[tid]);
+                    } else {
+                        for (int i = 0; i < ncol; i++) {
+                            if (is_pruned && zcol_prune_idx_[i0 + i] >= 0) {
+                                continue;
+                            }
+                            auto col = (fftw_complex_t*)&zbuf[i * zcol_stride_];
+                            fftw_t::execute_dft(plan_backward_z_[tid], col, col);
+                        }
+                    }
+
+                    /* redistribute z-columns for a forthcoming all-to-all or just load the
+                     * full columns into auxiliary buffer in serial case */
+                    for (int r = 0; r < spl_z_.num_ranks(); r++) {
+                        int lsz  = spl_z_.local_size(r);
+                        int offs = spl_z_.global_offset(r);
+
+                        /* this rank has transformed num_zcol_local columns; this rank has to repack
+                           them in blocks to send to other ranks */
+                        auto ptr = &fft_buffer_aux__[num_fft__ * a2a_send.offsets[r] + ifft * a2a_send.counts[r]];
+                        for (int i = 0; i < ncol; i++) {
+                            std::copy(&zbuf[i * zcol_stride_ + offs], &zbuf[i * zcol_stride_ + offs] + lsz,
+                                      &ptr[(i0 + i) * lsz]);
+                        }
+                    }
+                    break;
+                }
+                case -1: {
+                    /* collect full z-columns or just load them from the auxiliary buffer is serial case */
+                    for (int r = 0; r < spl_z_.num_ranks(); r++) {
+                        int lsz  = spl_z_.local_size(r);
+                        int offs = spl_z_.global_offset(r);
+
+                        auto ptr = &fft_buffer_aux__[num_fft__ * a2a_send.offsets[r] + ifft * a2a_send.counts[r]];
+                        for (int i = 0; i < ncol; i++) {
+                            std::copy(&ptr[(i0 + i) * lsz], &ptr[(i0 + i) * lsz] + lsz,
+                                      &zbuf[i * zcol_stride_ + offs]);
+                        }
+                    }
+
+                    /* perform local FFT transform of columns */
+                    if (ncol == zcol_block_size_ && !is_pruned) {
+                        fftw_t::execute(plan_forward_z_block_[tid]);
+                    } else {
+                        for (int i = 0; i < ncol; i++) {
+                            if (is_pruned && zcol_prune_idx_[i0 + i] >= 0) {
+                                continue;
+                            }
+                            auto col = (fftw_complex_t*)&zbuf[i * zcol_stride_];
+                            fftw_t::execute_dft(plan_forward_z_[tid], col, col);
+                        }
+                    }
+
+                    /* save z columns of PW coefficients; in the block with pruned columns the consecutive full
+                       columns are saved together and the pruned columns are transformed */
+                    int ga{g0};
+                    for (int i = 0; i < ncol && is_pruned; i++) {
+                        if (zcol_prune_idx_[i0 + i] < 0) {
+                            continue;
+                        }
+                        int icol        = gvec_partition_->idx_zcol<index_domain_t::local>(i0 + i);
+                        int data_offset = gvec_partition_->zcol_offs(icol);
+                        int ngv         = static_cast<int>(gvec_partition_->gvec().zcol(icol).z.size());
+
+                        unload_zcol_block(data_offset - ga, &map_gvec_to_fft_buffer_[ga], i0 * zcol_stride_, zbuf,
+                                          &data[ga], norm);
+                        transform_z_pruned_forward(zcol_prune_idx_[i0 + i], tid, ngv, &zcol_gvec_pos_[data_offset],
+                                                   &zbuf[i * zcol_stride_], &data[data_offset], norm);
+                        ga = data_offset + ngv;
+                    }
+                    unload_zcol_block(g1 - ga, &map_gvec_to_fft_buffer_[ga], i0 * zcol_stride_, zbuf, &data[ga], norm);
+                    break;
+                }
+                default: {
+                    TERMINATE("wrong direction");
+                }
+            }
+        };
+
+        /* split consecutive blocks of all functions into tasks of about the same cost */
+        int nblk = num_fft__ * num_blocks;
+        int nt   = omp_get_max_threads();
+
+        double task_cost = num_fft__ * (zcol_cost_[icol_end__] - zcol_cost_[icol_begin__]) /
+                           (nt * num_zcol_tasks_per_thread_);
+
+        std::vector<int> task_first(1, 0);
+        double cost{0};
+        for (int k = 0; k < nblk; k++) {
+            int i0 = icol_begin__ + (k % num_blocks) * zcol_block_size_;
+            int i1 = std::min(i0 + zcol_block_size_, icol_end__);
+            cost += zcol_cost_[i1] - zcol_cost_[i0];
+            if (k + 1 < nblk && cost >= task_cost * task_first.size()) {
+                task_first.push_back(k + 1);
+            }
+        }
+        task_first.push_back(nblk);
+        int num_tasks = static_cast<int>(task_first.size()) - 1;
+
+        /* each thread starts with a contiguous range of tasks */
+        std::vector<int> thread_first_task(nt + 1);
+        for (int i = 0; i <= nt; i++) {
+            thread_first_task[i] = static_cast<int>(static_cast<int64_t>(num_tasks) * i / nt);
+        }
+        task_queues queues(thread_first_task);
+
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+            int task;
+            while (queues.next(tid, task)) {
+                for (int k = task_first[task]; k < task_first[task + 1]; k++) {
+                    transform_block(k, tid);
+                }
+            }
+        }
+    }
+
     /// Serial part of 1D transformation of columns.
     /** Transform local set of z-columns from G-domain to r-domain or vice versa. The G-domain is
      *  located in data buffer, the r-domain is located in fft_buffer_aux. The template parameter mem 
@@ -261,18 +1969,11 @@ class FFT3D : public FFT3D_grid
      *  z-sticks ready for mpi_a2a. The size of the output array is num_zcol_local * size(z-direction).
      */
     template <int direction>
-    void transform_z_serial(double_complex* data__, mdarray<double_complex, 1>& fft_buffer_aux__,
+    void transform_z_serial(complex_t* data__, mdarray<complex_t, 1>& fft_buffer_aux__,
                             void* acc_fft_plan_z__, memory_t mem__)
     {
         PROFILE("sddk::FFT3D::transform_z_serial");
 
-        /* local number of z-columns to transform */
-        int num_zcol_local = gvec_partition_->zcol_count_fft();
-
-        double norm = 1.0 / size();
-
-        bool is_reduced = gvec_partition_->gvec().reduced();
-
         assert(static_cast<int>(fft_buffer_aux__.size()) >= gvec_partition_->zcol_count_fft() * size(2));
 
         /* input/output data buffer is on device memory */
@@ -280,25 +1981,32 @@ class FFT3D : public FFT3D_grid
             utils::timer t("sddk::FFT3D::transform_z_serial|gpu");
 #if defined(__GPU)
 #if defined(__CUDA)
+            /* local number of z-columns to transform */
+            int num_zcol_local = gvec_partition_->zcol_count_fft();
+
+            T norm = 1.0 / size();
+
+            bool is_reduced = gvec_partition_->gvec().reduced();
+
             switch (direction) {
                 case 1: {
                     /* load all columns into FFT buffer */
                     batch_load_gpu(num_zcol_local * size(2), gvec_partition_->gvec_count_fft(), 1,
-                                   map_gvec_to_fft_buffer_.at(memory_t::device), data__,
-                                   fft_buffer_aux__.at(memory_t::device), acc_fft_stream_id_);
+                                   map_gvec_to_fft_buffer_.at(memory_t::device), acc_ptr(data__),
+                                   acc_ptr(fft_buffer_aux__.at(memory_t::device)), acc_fft_stream_id_);
                     if (is_reduced && comm_.rank() == 0) {
                         load_x0y0_col_gpu(static_cast<int>(gvec_partition_->gvec().zcol(0).z.size()),
-                                          map_gvec_to_fft_buffer_x0y0_.at(memory_t::device), data__,
-                                          fft_buffer_aux__.at(memory_t::device), acc_fft_stream_id_);
+                                          map_gvec_to_fft_buffer_x0y0_.at(memory_t::device), acc_ptr(data__),
+                                          acc_ptr(fft_buffer_aux__.at(memory_t::device)), acc_fft_stream_id_);
                     }
                     /* transform all columns */
-                    cufft::backward_transform(acc_fft_plan_z__, fft_buffer_aux__.at(memory_t::device));
+                    cufft::backward_transform(acc_fft_plan_z__, acc_ptr(fft_buffer_aux__.at(memory_t::device)));
 
                     /* repack from fft_buffer_aux to fft_buffer */
                     repack_z_buffer_gpu(direction, comm_.size(), size(2), num_zcol_local, max_zloc_size_,
                                         z_offsets_.at(memory_t::device), z_sizes_.at(memory_t::device),
-                                        fft_buffer_aux__.at(memory_t::device),
-                                        fft_buffer_.at(memory_t::device));
+                                        acc_ptr(fft_buffer_aux__.at(memory_t::device)),
+                                        acc_ptr(fft_buffer_.at(memory_t::device)));
 
                     /* copy back to fft_buffer_aux */
                     acc::copy(fft_buffer_aux__.at(memory_t::device), fft_buffer_.at(memory_t::device),
@@ -314,15 +2022,15 @@ class FFT3D : public FFT3D_grid
                     /* repack the buffer back */
                     repack_z_buffer_gpu(direction, comm_.size(), size(2), num_zcol_local, max_zloc_size_,
                                         z_offsets_.at(memory_t::device), z_sizes_.at(memory_t::device),
-                                        fft_buffer_aux__.at(memory_t::device),
-                                        fft_buffer_.at(memory_t::device));
+                                        acc_ptr(fft_buffer_aux__.at(memory_t::device)),
+                                        acc_ptr(fft_buffer_.at(memory_t::device)));
 
                     /* transform all columns */
-                    cufft::forward_transform(acc_fft_plan_z__, fft_buffer_aux__.at(memory_t::device));
+                    cufft::forward_transform(acc_fft_plan_z__, acc_ptr(fft_buffer_aux__.at(memory_t::device)));
                     /* get all columns from FFT buffer */
                     batch_unload_gpu(gvec_partition_->zcol_count_fft() * size(2),
                                      gvec_partition_->gvec_count_fft(), 1, map_gvec_to_fft_buffer_.at(memory_t::device),
-                                     fft_buffer_aux__.at(memory_t::device), data__, 0.0,
+                                     acc_ptr(fft_buffer_aux__.at(memory_t::device)), acc_ptr(data__), 0.0,
                                      norm, acc_fft_stream_id_);
                     break;
                 }
@@ -337,88 +2045,98 @@ class FFT3D : public FFT3D_grid
 
         /* data is host memory */
         if (is_host_memory(mem__)) {
-            utils::timer t("sddk::FFT3D::transform_z_serial|cpu");
-            #pragma omp parallel for schedule(dynamic, 1)
-            for (int i = 0; i < num_zcol_local; i++) {
-                /* id of the thread */
-                int tid = omp_get_thread_num();
-                /* global index of column */
-                int icol = gvec_partition_->idx_zcol<index_domain_t::local>(i);
-                /* offset of the PW coeffs in the input/output data buffer */
-                int data_offset = gvec_partition_->zcol_offs(icol);
-
-                switch (direction) {
-                    case 1: {
-                        /* clear z buffer */
-                        std::fill(fftw_buffer_z_[tid], fftw_buffer_z_[tid] + size(2), 0);
-                        /* load z column  of PW coefficients into buffer */
-                        for (size_t j = 0; j < gvec_partition_->gvec().zcol(icol).z.size(); j++) {
-                            int z                  = coord_by_freq<2>(gvec_partition_->gvec().zcol(icol).z[j]);
-                            fftw_buffer_z_[tid][z] = data__[data_offset + j];
-                        }
-
-                        /* column with {x,y} = {0,0} has only non-negative z components */
-                        if (is_reduced && !icol) {
-                            /* load remaining part of {0,0,z} column */
-                            for (size_t j = 0; j < gvec_partition_->gvec().zcol(icol).z.size(); j++) {
-                                int z                  = coord_by_freq<2>(-gvec_partition_->gvec().zcol(icol).z[j]);
-                                fftw_buffer_z_[tid][z] = std::conj(data__[data_offset + j]);
-                            }
-                        }
-
-                        /* perform local FFT transform of a column */
-                        fftw_execute(plan_backward_z_[tid]);
+            transform_z_serial_cpu<direction>(1, &data__, fft_buffer_aux__.at(memory_t::host));
+        }
+    }
 
-                        /* redistribute z-column for a forthcoming all-to-all or just load the
-                         * full column into auxiliary buffer in serial case */
-                        for (int r = 0; r < comm_.size(); r++) {
-                            int lsz  = spl_z_.local_size(r);
-                            int offs = spl_z_.global_offset(r);
+    /// Pipelined transformation of z-columns on the CPU.
+    /** Local z-columns are split into chunks and each chunk is exchanged with a non-blocking all-to-all. In the
+     *  backward transformation the exchange of a chunk overlaps with the transformation of the next chunks; in the
+     *  forward transformation all exchanges are posted at once and each chunk is transformed as soon as it has
+     *  arrived. The final layout of the data is the same as in the blocking version. */
+    template <int direction>
+    void transform_z_pipelined(complex_t* data__, mdarray<complex_t, 1>& fft_buffer_aux__)
+    {
+        PROFILE("sddk::FFT3D::transform_z_pipelined");
 
-                            /* this rank has transformed num_zcol_local columns; this rank has to repack
-                               them in blocks to send to other ranks */
-                            std::copy(&fftw_buffer_z_[tid][offs], &fftw_buffer_z_[tid][offs] + lsz,
-                                      &fft_buffer_aux__[offs * num_zcol_local + i * lsz]);
-                        }
-                        break;
-                    }
-                    case -1: {
-                        /* collect full z-column or just load it from the auxiliary buffer is serial case */
-                        for (int r = 0; r < comm_.size(); r++) {
-                            int lsz  = spl_z_.local_size(r);
-                            int offs = spl_z_.global_offset(r);
+        /* local stick size times full number of z-columns */
+        int a2a_size = gvec_partition_->gvec().num_zcol() * local_size_z();
 
-                            std::copy(&fft_buffer_aux__[offs * num_zcol_local + i * lsz],
-                                      &fft_buffer_aux__[offs * num_zcol_local + i * lsz] + lsz,
-                                      &fftw_buffer_z_[tid][offs]);
-                        }
+        int num_chunks = static_cast<int>(a2a_chunk_zcol_.size());
 
-                        /* perform local FFT transform of a column */
-                        fftw_execute(plan_forward_z_[tid]);
+        std::vector<MPI_Request> req(num_chunks);
 
-                        /* save z column of PW coefficients */
-                        for (size_t j = 0; j < gvec_partition_->gvec().zcol(icol).z.size(); j++) {
-                            int z                   = coord_by_freq<2>(gvec_partition_->gvec().zcol(icol).z[j]);
-                            data__[data_offset + j] = fftw_buffer_z_[tid][z] * norm;
-                        }
+        auto aux = fft_buffer_aux__.at(memory_t::host);
+        /* receiving (direction=1) or sending (direction=-1) storage of the exchange */
+        auto buf = a2a_double_buffer_ ? fft_buffer_a2a_.at(memory_t::host) : fft_buffer_.at(memory_t::host);
 
-                        break;
-                    }
-                    default: {
-                        TERMINATE("wrong direction");
-                    }
+        switch (direction) {
+            case 1: {
+                for (int c = 0; c < num_chunks; c++) {
+                    transform_z_serial_cpu<direction>(1, &data__, aux, a2a_chunk_zcol_[c].first,
+                                                      a2a_chunk_zcol_[c].second);
+                    /* scatter z-columns of this chunk into the receiving storage */
+                    comm_.ialltoall(aux, a2a_send_chunk_[c].counts.data(), a2a_send_chunk_[c].offsets.data(), buf,
+                                    a2a_recv_chunk_[c].counts.data(), a2a_recv_chunk_[c].offsets.data(), &req[c]);
+                    /* give MPI a chance to progress the previous exchanges */
+                    int flag;
+                    CALL_MPI(MPI_Testall, (c + 1, req.data(), &flag, MPI_STATUSES_IGNORE));
+                }
+                utils::timer t("sddk::FFT3D::transform_z|comm");
+                CALL_MPI(MPI_Waitall, (num_chunks, req.data(), MPI_STATUSES_IGNORE));
+                t.stop();
+                if (a2a_double_buffer_) {
+                    /* received local fractions of z-columns become the auxiliary buffer */
+                    std::swap(fft_buffer_aux__, fft_buffer_a2a_);
+                } else {
+                    /* copy local fractions of z-columns back into auxiliary buffer */
+                    std::copy(buf, buf + a2a_size, aux);
                 }
+                break;
+            }
+            case -1: {
+                if (a2a_double_buffer_) {
+                    /* packed z-sticks become the send buffer; the auxiliary buffer receives full sticks */
+                    std::swap(fft_buffer_aux__, fft_buffer_a2a_);
+                    aux = fft_buffer_aux__.at(memory_t::host);
+                    buf = fft_buffer_a2a_.at(memory_t::host);
+                } else {
+                    /* copy auxiliary buffer because it will be use as the output buffer in the following mpi_a2a */
+                    std::copy(aux, aux + a2a_size, buf);
+                }
+                /* collect full sticks; send and recieve dimensions are interchanged */
+                for (int c = 0; c < num_chunks; c++) {
+                    comm_.ialltoall(buf, a2a_recv_chunk_[c].counts.data(), a2a_recv_chunk_[c].offsets.data(), aux,
+                                    a2a_send_chunk_[c].counts.data(), a2a_send_chunk_[c].offsets.data(), &req[c]);
+                }
+                for (int c = 0; c < num_chunks; c++) {
+                    utils::timer t("sddk::FFT3D::transform_z|comm");
+                    CALL_MPI(MPI_Wait, (&req[c], MPI_STATUS_IGNORE));
+                    t.stop();
+                    transform_z_serial_cpu<direction>(1, &data__, aux, a2a_chunk_zcol_[c].first,
+                                                      a2a_chunk_zcol_[c].second);
+                }
+                break;
+            }
+            default: {
+                TERMINATE("wrong direction");
             }
         }
     }
 
     /// Transformation of z-columns.
     template <int direction>
-    void transform_z(double_complex* data__, mdarray<double_complex, 1>& fft_buffer_aux__, void* acc_fft_plan_z__,
+    void transform_z(complex_t* data__, mdarray<complex_t, 1>& fft_buffer_aux__, void* acc_fft_plan_z__,
                      memory_t mem__)
     {
         PROFILE("sddk::FFT3D::transform_z");
 
+        if (pu_ == device_t::CPU && comm_.size() > 1 && !a2a_chunk_zcol_.empty() &&
+            a2a_compression_ == a2a_compression_t::none) {
+            transform_z_pipelined<direction>(data__, fft_buffer_aux__);
+            return;
+        }
+
         //int rank = comm_.rank();
 
         /* full stick size times local number of z-columns */
@@ -439,7 +2157,15 @@ class FFT3D : public FFT3D_grid
             }
 
             /* collect full sticks */
-            if (comm_.size() > 1) {
+            if (comm_.size() > 1 && pu_ == device_t::CPU && a2a_double_buffer_) {
+                utils::timer t("sddk::FFT3D::transform_z|comm");
+
+                /* packed z-sticks become the send buffer; the auxiliary buffer receives full sticks */
+                std::swap(fft_buffer_aux__, fft_buffer_a2a_);
+
+                alltoall_z(fft_buffer_a2a_.at(memory_t::host), a2a_recv.counts.data(), a2a_recv.offsets.data(),
+                           fft_buffer_aux__.at(memory_t::host), a2a_send.counts.data(), a2a_send.offsets.data());
+            } else if (comm_.size() > 1) {
                 utils::timer t("sddk::FFT3D::transform_z|comm");
 
                 if (is_host_memory(mem__) || !is_gpu_direct_) {
@@ -453,8 +2179,9 @@ class FFT3D : public FFT3D_grid
                               a2a_size);
                 }
 
-                comm_.alltoall(fft_buffer_.at(a2a_mem_type), a2a_recv.counts.data(), a2a_recv.offsets.data(),
-                               fft_buffer_aux__.at(a2a_mem_type), a2a_send.counts.data(), a2a_send.offsets.data());
+                alltoall_z(fft_buffer_.at(a2a_mem_type), a2a_recv.counts.data(), a2a_recv.offsets.data(),
+                           fft_buffer_aux__.at(a2a_mem_type), a2a_send.counts.data(), a2a_send.offsets.data(),
+                           a2a_mem_type);
 
                 /* buffer is on CPU after mpi_a2a and has to be copied to GPU */
                 if (is_device_memory(mem__) && !is_gpu_direct_) {
@@ -467,7 +2194,15 @@ class FFT3D : public FFT3D_grid
 
         if (direction == 1) {
             /* scatter z-columns between slabs of FFT buffer */
-            if (comm_.size() > 1) {
+            if (comm_.size() > 1 && pu_ == device_t::CPU && a2a_double_buffer_) {
+                utils::timer t("sddk::FFT3D::transform_z|comm");
+
+                alltoall_z(fft_buffer_aux__.at(memory_t::host), a2a_send.counts.data(), a2a_send.offsets.data(),
+                           fft_buffer_a2a_.at(memory_t::host), a2a_recv.counts.data(), a2a_recv.offsets.data());
+
+                /* received local fractions of z-columns become the auxiliary buffer */
+                std::swap(fft_buffer_aux__, fft_buffer_a2a_);
+            } else if (comm_.size() > 1) {
                 utils::timer t("sddk::FFT3D::transform_z|comm");
 
                 /* copy to host if we are not using GPU direct */
@@ -476,8 +2211,9 @@ class FFT3D : public FFT3D_grid
                 }
 
                 /* scatter z-columns; use fft_buffer_ as receiving temporary storage */
-                comm_.alltoall(fft_buffer_aux__.at(a2a_mem_type), a2a_send.counts.data(), a2a_send.offsets.data(),
-                               fft_buffer_.at(a2a_mem_type), a2a_recv.counts.data(), a2a_recv.offsets.data());
+                alltoall_z(fft_buffer_aux__.at(a2a_mem_type), a2a_send.counts.data(), a2a_send.offsets.data(),
+                           fft_buffer_.at(a2a_mem_type), a2a_recv.counts.data(), a2a_recv.offsets.data(),
+                           a2a_mem_type);
 
                 if (is_host_memory(mem__) || !is_gpu_direct_) {
                     /* copy local fractions of z-columns back into auxiliary buffer */
@@ -498,17 +2234,257 @@ class FFT3D : public FFT3D_grid
         }
     }
 
+    /// Apply 2D FFT transformation to z-columns of a batch of functions on the CPU.
+    /** The z-columns of the function ifft are stored in fft_buffer_aux at the offset ifft * num_zcol * local_size_z
+     *  and the xy-planes are stored in fft_buffer at the offset ifft * local_size.
+     *
+     *  The 2D transformation is decomposed into 1D transformations: in the backward direction y-lines are transformed
+     *  only for the x-coordinates touched by the z-columns and then all x-rows are transformed; the forward direction
+     *  goes in the opposite order. In case of reduced G-vector set the function is real, only half of the x-range
+     *  is stored and x-rows are transformed with real-to-complex FFTs. */
+    template <int direction>
+    void transform_xy_cpu(int num_fft__, complex_t* fft_buffer_aux__, complex_t* fft_buffer__)
+    {
+        if (num_fft__ * local_size_z() < xy_split_planes_) {
+            transform_xy_cpu_split<direction>(num_fft__, fft_buffer_aux__, fft_buffer__);
+            return;
+        }
+
+        int size_xy = size(0) * size(1);
+
+        bool is_reduced = gvec_partition_->gvec().reduced();
+
+        int num_zcol = gvec_partition_->gvec().num_zcol();
+
+        /* number of x-coordinates touched by z-columns */
+        int ntx = static_cast<int>(zcol_x_.size());
+
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < num_fft__ * local_size_z(); k++) {
+            int tid = omp_get_thread_num();
+            /* index of the function */
+            int ifft = k / local_size_z();
+            /* local index of the xy-plane */
+            int iz = k % local_size_z();
+
+            auto aux = &fft_buffer_aux__[static_cast<size_t>(ifft) * num_zcol * local_size_z()];
+            auto buf = &fft_buffer__[static_cast<size_t>(ifft) * local_size() + iz * size_xy];
+
+            /* compact buffer of y-lines */
+            auto ybuf = fftw_buffer_xy_[tid];
+            /* buffer of a single x-row */
+            auto xbuf = fftw_buffer_x_[tid];
+            auto xbuf_r = fftw_buffer_xy_r_[tid];
+
+            switch (direction) {
+                case 1: {
+                    /* clear y-lines */
+                    std::fill(ybuf, ybuf + ntx * size(1), 0);
+                    /* load z-columns into proper location */
+                    for (int i = 0; i < num_zcol; i++) {
+                        auto z = aux[iz + i * local_size_z()];
+                        if (z_col_pos_y_(i, 0) >= 0) {
+                            ybuf[z_col_pos_y_(i, 0)] = z;
+                        }
+                        if (is_reduced && i && z_col_pos_y_(i, 1) >= 0) {
+                            ybuf[z_col_pos_y_(i, 1)] = std::conj(z);
+                        }
+                    }
+
+                    /* transform non-zero y-lines */
+                    fftw_t::execute(plan_backward_y_lines_[tid]);
+
+                    /* transform x-rows and store them in the main FFT buffer */
+                    for (int y = 0; y < size(1); y++) {
+                        std::fill(xbuf, xbuf + size(0), 0);
+                        for (int ix = 0; ix < ntx; ix++) {
+                            xbuf[zcol_x_[ix]] = ybuf[ix * size(1) + y];
+                        }
+                        if (is_reduced) {
+                            fftw_t::execute(plan_backward_x_c2r_[tid]);
+                            for (int x = 0; x < size(0); x++) {
+                                buf[x + y * size(0)] = complex_t(xbuf_r[x], 0);
+                            }
+                        } else {
+                            fftw_t::execute(plan_backward_x_[tid]);
+                            std::copy(xbuf, xbuf + size(0), &buf[y * size(0)]);
+                        }
+                    }
+                    break;
+                }
+                case -1: {
+                    /* transform x-rows and keep the y-lines touched by z-columns */
+                    for (int y = 0; y < size(1); y++) {
+                        if (is_reduced) {
+                            for (int x = 0; x < size(0); x++) {
+                                xbuf_r[x] = buf[x + y * size(0)].real();
+                            }
+                            fftw_t::execute(plan_forward_x_r2c_[tid]);
+                        } else {
+                            std::copy(&buf[y * size(0)], &buf[y * size(0)] + size(0), xbuf);
+                            fftw_t::execute(plan_forward_x_[tid]);
+                        }
+                        for (int ix = 0; ix < ntx; ix++) {
+                            ybuf[ix * size(1) + y] = xbuf[zcol_x_[ix]];
+                        }
+                    }
+
+                    /* transform y-lines */
+                    fftw_t::execute(plan_forward_y_lines_[tid]);
+
+                    /* get z-columns */
+                    for (int i = 0; i < num_zcol; i++) {
+                        if (z_col_pos_y_(i, 0) >= 0) {
+                            aux[iz + i * local_size_z()] = ybuf[z_col_pos_y_(i, 0)];
+                        } else {
+                            aux[iz + i * local_size_z()] = std::conj(ybuf[z_col_pos_y_(i, 1)]);
+                        }
+                    }
+                    break;
+                }
+                default: {
+                    TERMINATE("wrong direction");
+                }
+            }
+        }
+    }
+
+    /// Apply 2D FFT transformation to z-columns of a batch of functions on the CPU with all threads per plane.
+    /** This is used when the number of xy-planes is smaller than the number of threads. The planes are processed one
+     *  by one and the 1D transformations of each plane (y-lines touched by z-columns and x-rows) are distributed
+     *  between threads. The y-lines of the plane are stored in the first xy-buffer; the layout of the input and
+     *  output is the same as in transform_xy_cpu(). */
+    template <int direction>
+    void transform_xy_cpu_split(int num_fft__, complex_t* fft_buffer_aux__, complex_t* fft_buffer__)
+    {
+        int size_xy = size(0) * size(1);
+
+        bool is_reduced = gvec_partition_->gvec().reduced();
+
+        int num_zcol = gvec_partition_->gvec().num_zcol();
+
+        /* number of x-coordinates touched by z-columns */
+        int ntx = static_cast<int>(zcol_x_.size());
+
+        /* compact buffer of y-lines shared by all threads */
+        auto ybuf = fftw_buffer_xy_[0];
+
+        for (int k = 0; k < num_fft__ * local_size_z(); k++) {
+            /* index of the function */
+            int ifft = k / local_size_z();
+            /* local index of the xy-plane */
+            int iz = k % local_size_z();
+
+            auto aux = &fft_buffer_aux__[static_cast<size_t>(ifft) * num_zcol * local_size_z()];
+            auto buf = &fft_buffer__[static_cast<size_t>(ifft) * local_size() + iz * size_xy];
+
+            #pragma omp parallel
+            {
+                int tid = omp_get_thread_num();
+
+                auto ylin = fftw_buffer_y_[tid];
+                /* buffer of a single x-row */
+                auto xbuf = fftw_buffer_x_[tid];
+                auto xbuf_r = fftw_buffer_xy_r_[tid];
+
+                switch (direction) {
+                    case 1: {
+                        /* clear y-lines */
+                        #pragma omp for schedule(static)
+                        for (int ix = 0; ix < ntx; ix++) {
+                            std::fill(&ybuf[ix * size(1)], &ybuf[ix * size(1)] + size(1), 0);
+                        }
+                        /* load z-columns into proper location */
+                        #pragma omp for schedule(static)
+                        for (int i = 0; i < num_zcol; i++) {
+                            auto z = aux[iz + i * local_size_z()];
+                            if (z_col_pos_y_(i, 0) >= 0) {
+                                ybuf[z_col_pos_y_(i, 0)] = z;
+                            }
+                            if (is_reduced && i && z_col_pos_y_(i, 1) >= 0) {
+                                ybuf[z_col_pos_y_(i, 1)] = std::conj(z);
+                            }
+                        }
+
+                        /* transform non-zero y-lines */
+                        #pragma omp for schedule(static)
+                        for (int ix = 0; ix < ntx; ix++) {
+                            std::copy(&ybuf[ix * size(1)], &ybuf[ix * size(1)] + size(1), ylin);
+                            fftw_t::execute(plan_backward_y_[tid]);
+                            std::copy(ylin, ylin + size(1), &ybuf[ix * size(1)]);
+                        }
+
+                        /* transform x-rows and store them in the main FFT buffer */
+                        #pragma omp for schedule(static)
+                        for (int y = 0; y < size(1); y++) {
+                            std::fill(xbuf, xbuf + size(0), 0);
+                            for (int ix = 0; ix < ntx; ix++) {
+                                xbuf[zcol_x_[ix]] = ybuf[ix * size(1) + y];
+                            }
+                            if (is_reduced) {
+                                fftw_t::execute(plan_backward_x_c2r_[tid]);
+                                for (int x = 0; x < size(0); x++) {
+                                    buf[x + y * size(0)] = complex_t(xbuf_r[x], 0);
+                                }
+                            } else {
+                                fftw_t::execute(plan_backward_x_[tid]);
+                                std::copy(xbuf, xbuf + size(0), &buf[y * size(0)]);
+                            }
+                        }
+                        break;
+                    }
+                    case -1: {
+                        /* transform x-rows and keep the y-lines touched by z-columns */
+                        #pragma omp for schedule(static)
+                        for (int y = 0; y < size(1); y++) {
+                            if (is_reduced) {
+                                for (int x = 0; x < size(0); x++) {
+                                    xbuf_r[x] = buf[x + y * size(0)].real();
+                                }
+                                fftw_t::execute(plan_forward_x_r2c_[tid]);
+                            } else {
+                                std::copy(&buf[y * size(0)], &buf[y * size(0)] + size(0), xbuf);
+                                fftw_t::execute(plan_forward_x_[tid]);
+                            }
+                            for (int ix = 0; ix < ntx; ix++) {
+                                ybuf[ix * size(1) + y] = xbuf[zcol_x_[ix]];
+                            }
+                        }
+
+                        /* transform y-lines */
+                        #pragma omp for schedule(static)
+                        for (int ix = 0; ix < ntx; ix++) {
+                            std::copy(&ybuf[ix * size(1)], &ybuf[ix * size(1)] + size(1), ylin);
+                            fftw_t::execute(plan_forward_y_[tid]);
+                            std::copy(ylin, ylin + size(1), &ybuf[ix * size(1)]);
+                        }
+
+                        /* get z-columns */
+                        #pragma omp for schedule(static)
+                        for (int i = 0; i < num_zcol; i++) {
+                            if (z_col_pos_y_(i, 0) >= 0) {
+                                aux[iz + i * local_size_z()] = ybuf[z_col_pos_y_(i, 0)];
+                            } else {
+                                aux[iz + i * local_size_z()] = std::conj(ybuf[z_col_pos_y_(i, 1)]);
+                            }
+                        }
+                        break;
+                    }
+                    default: {
+                        TERMINATE("wrong direction");
+                    }
+                }
+            }
+        }
+    }
+
     /// Apply 2D FFT transformation to z-columns of one complex function.
     /** The transformation is always done in the memory of processing unit. */
     template <int direction>
-    void transform_xy(mdarray<double_complex, 1>& fft_buffer_aux__)
+    void transform_xy(mdarray<complex_t, 1>& fft_buffer_aux__)
     {
         PROFILE("sddk::FFT3D::transform_xy");
 
-        int size_xy = size(0) * size(1);
-
-        int is_reduced = gvec_partition_->gvec().reduced();
-
         switch (pu_) {
             case device_t::GPU: {
 #if defined(__GPU)
@@ -517,20 +2493,20 @@ class FFT3D : public FFT3D_grid
                 switch (direction) {
                     case 1: {
                         /* srteam #0 unpacks z-columns into proper position of FFT buffer */
-                        unpack_z_cols_gpu(fft_buffer_aux__.at(memory_t::device),
-                                          fft_buffer_.at(memory_t::device), size(0), size(1), local_size_z(),
-                                          gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device), is_reduced,
-                                          acc_fft_stream_id_);
+                        unpack_z_cols_gpu(acc_ptr(fft_buffer_aux__.at(memory_t::device)),
+                                          acc_ptr(fft_buffer_.at(memory_t::device)), size(0), size(1), local_size_z(),
+                                          gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device),
+                                          gvec_partition_->gvec().reduced(), acc_fft_stream_id_);
                         /* stream #0 executes FFT */
-                        cufft::backward_transform(acc_fft_plan_xy_backward_, fft_buffer_.at(memory_t::device));
+                        cufft::backward_transform(acc_fft_plan_xy_backward_, acc_ptr(fft_buffer_.at(memory_t::device)));
                         break;
                     }
                     case -1: {
                         /* stream #0 executes FFT */
-                        cufft::forward_transform(acc_fft_plan_xy_forward_, fft_buffer_.at(memory_t::device));
+                        cufft::forward_transform(acc_fft_plan_xy_forward_, acc_ptr(fft_buffer_.at(memory_t::device)));
                         /* stream #0 packs z-columns */
-                        pack_z_cols_gpu(fft_buffer_aux__.at(memory_t::device),
-                                        fft_buffer_.at(memory_t::device), size(0), size(1), local_size_z(),
+                        pack_z_cols_gpu(acc_ptr(fft_buffer_aux__.at(memory_t::device)),
+                                        acc_ptr(fft_buffer_.at(memory_t::device)), size(0), size(1), local_size_z(),
                                         gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device), acc_fft_stream_id_);
                         break;
                     }
@@ -541,25 +2517,86 @@ class FFT3D : public FFT3D_grid
                 break;
             }
             case device_t::CPU: {
-                #pragma omp parallel for schedule(static)
+                transform_xy_cpu<direction>(1, fft_buffer_aux__.at(memory_t::host), fft_buffer_.at(memory_t::host));
+                break;
+            }
+        }
+    }
+
+    /// Apply 2D FFT transformation to z-columns of two real functions.
+    /** The transformation is always done in the memory of processing unit. */
+    template <int direction>
+    void transform_xy(mdarray<complex_t, 1>& fft_buffer_aux1__, mdarray<complex_t, 1>& fft_buffer_aux2__)
+    {
+        PROFILE("sddk::FFT3D::transform_xy");
+
+        if (!gvec_partition_->gvec().reduced()) {
+            TERMINATE("reduced set of G-vectors is required");
+        }
+
+        int size_xy = size(0) * size(1);
+
+#if defined(__GPU)
+#if defined(__CUDA)
+        if (pu_ == device_t::GPU) {
+            /* stream #0 will be doing cuFFT */
+            switch (direction) {
+                case 1: {
+                    /* srteam #0 unpacks z-columns into proper position of FFT buffer */
+                    unpack_z_cols_2_gpu(acc_ptr(fft_buffer_aux1__.at(memory_t::device)),
+                                        acc_ptr(fft_buffer_aux2__.at(memory_t::device)),
+                                        acc_ptr(fft_buffer_.at(memory_t::device)), size(0), size(1), local_size_z(),
+                                        gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device), acc_fft_stream_id_);
+                    /* stream #0 executes FFT */
+                    cufft::backward_transform(acc_fft_plan_xy_backward_, acc_ptr(fft_buffer_.at(memory_t::device)));
+                    break;
+                }
+                case -1: {
+                    /* stream #0 executes FFT */
+                    cufft::forward_transform(acc_fft_plan_xy_forward_, acc_ptr(fft_buffer_.at(memory_t::device)));
+                    /* stream #0 packs z-columns */
+                    pack_z_cols_2_gpu(acc_ptr(fft_buffer_aux1__.at(memory_t::device)),
+                                      acc_ptr(fft_buffer_aux2__.at(memory_t::device)),
+                                      acc_ptr(fft_buffer_.at(memory_t::device)), size(0), size(1), local_size_z(),
+                                      gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device), acc_fft_stream_id_);
+                    break;
+                }
+            }
+            acc::sync_stream(stream_id(acc_fft_stream_id_));
+        }
+#endif
+#endif
+
+        if (pu_ == device_t::CPU) {
+            #pragma omp parallel
+            {
+                int tid = omp_get_thread_num();
+                #pragma omp for schedule(static)
                 for (int iz = 0; iz < local_size_z(); iz++) {
-                    int tid = omp_get_thread_num();
                     switch (direction) {
                         case 1: {
                             /* clear xy-buffer */
                             std::fill(fftw_buffer_xy_[tid], fftw_buffer_xy_[tid] + size_xy, 0);
-                            /* load z-columns into proper location */
-                            for (int i = 0; i < gvec_partition_->gvec().num_zcol(); i++) {
-                                fftw_buffer_xy_[tid][z_col_pos_(i, 0)] = fft_buffer_aux__[iz + i * local_size_z()];
 
-                                if (is_reduced && i) {
-                                    fftw_buffer_xy_[tid][z_col_pos_(i, 1)] =
-                                        std::conj(fftw_buffer_xy_[tid][z_col_pos_(i, 0)]);
-                                }
+                            /* load first z-column into proper location */
+                            fftw_buffer_xy_[tid][z_col_pos_(0, 0)] =
+                                fft_buffer_aux1__[iz] + complex_t(0, 1) * fft_buffer_aux2__[iz];
+
+                            /* load remaining z-columns into proper location */
+                            for (int i = 1; i < gvec_partition_->gvec().num_zcol(); i++) {
+                                /* {x, y} part */
+                                fftw_buffer_xy_[tid][z_col_pos_(i, 0)] =
+                                    fft_buffer_aux1__[iz + i * local_size_z()] +
+                                    complex_t(0, 1) * fft_buffer_aux2__[iz + i * local_size_z()];
+
+                                /* {-x, -y} part */
+                                fftw_buffer_xy_[tid][z_col_pos_(i, 1)] =
+                                    std::conj(fft_buffer_aux1__[iz + i * local_size_z()]) +
+                                    complex_t(0, 1) * std::conj(fft_buffer_aux2__[iz + i * local_size_z()]);
                             }
 
                             /* execute local FFT transform */
-                            fftw_execute(plan_backward_xy_[tid]);
+                            fftw_t::execute(plan_backward_xy_[tid]);
 
                             /* copy xy plane to the main FFT buffer */
                             std::copy(fftw_buffer_xy_[tid], fftw_buffer_xy_[tid] + size_xy, &fft_buffer_[iz * size_xy]);
@@ -572,11 +2609,17 @@ class FFT3D : public FFT3D_grid
                                       fftw_buffer_xy_[tid]);
 
                             /* execute local FFT transform */
-                            fftw_execute(plan_forward_xy_[tid]);
+                            fftw_t::execute(plan_forward_xy_[tid]);
 
                             /* get z-columns */
                             for (int i = 0; i < gvec_partition_->gvec().num_zcol(); i++) {
-                                fft_buffer_aux__[iz + i * local_size_z()] = fftw_buffer_xy_[tid][z_col_pos_(i, 0)];
+                                fft_buffer_aux1__[iz + i * local_size_z()] =
+                                    T(0.5) * (fftw_buffer_xy_[tid][z_col_pos_(i, 0)] +
+                                              std::conj(fftw_buffer_xy_[tid][z_col_pos_(i, 1)]));
+
+                                fft_buffer_aux2__[iz + i * local_size_z()] =
+                                    complex_t(0, -0.5) * (fftw_buffer_xy_[tid][z_col_pos_(i, 0)] -
+                                                          std::conj(fftw_buffer_xy_[tid][z_col_pos_(i, 1)]));
                             }
 
                             break;
@@ -586,168 +2629,1055 @@ class FFT3D : public FFT3D_grid
                         }
                     }
                 }
-                break;
             }
         }
     }
 
-    /// Apply 2D FFT transformation to z-columns of two real functions.
-    /** The transformation is always done in the memory of processing unit. */
-    template <int direction>
-    void transform_xy(mdarray<double_complex, 1>& fft_buffer_aux1__, mdarray<double_complex, 1>& fft_buffer_aux2__)
+    /// Accumulate the weighted density of a batch of functions in a fused xy-step on the CPU.
+    /** Each xy-plane of each function is transformed to real space row by row in the per-thread buffers and
+     *  the weighted squared magnitude is added to rho_r. The xy-planes are distributed between threads and all
+     *  functions of a plane are processed by the same thread, so no reduction of rho_r is needed. */
+    void accumulate_density_xy_cpu(int num_fft__, complex_t* fft_buffer_aux__, T const* weights__, T* rho_r__)
+    {
+        PROFILE("sddk::FFT3D::accumulate_density_xy");
+
+        int size_xy = size(0) * size(1);
+
+        bool is_reduced = gvec_partition_->gvec().reduced();
+
+        int num_zcol = gvec_partition_->gvec().num_zcol();
+
+        /* number of x-coordinates touched by z-columns */
+        int ntx = static_cast<int>(zcol_x_.size());
+
+        #pragma omp parallel for schedule(static)
+        for (int iz = 0; iz < local_size_z(); iz++) {
+            int tid = omp_get_thread_num();
+
+            auto rho = &rho_r__[iz * size_xy];
+
+            /* compact buffer of y-lines */
+            auto ybuf = fftw_buffer_xy_[tid];
+            /* buffer of a single x-row */
+            auto xbuf = fftw_buffer_x_[tid];
+            auto xbuf_r = fftw_buffer_xy_r_[tid];
+
+            for (int ifft = 0; ifft < num_fft__; ifft++) {
+                auto aux = &fft_buffer_aux__[static_cast<size_t>(ifft) * num_zcol * local_size_z() + iz];
+                T w = weights__[ifft];
+
+                /* clear y-lines */
+                std::fill(ybuf, ybuf + ntx * size(1), 0);
+                /* load z-columns into proper location */
+                for (int i = 0; i < num_zcol; i++) {
+                    auto z = aux[i * local_size_z()];
+                    if (z_col_pos_y_(i, 0) >= 0) {
+                        ybuf[z_col_pos_y_(i, 0)] = z;
+                    }
+                    if (is_reduced && i && z_col_pos_y_(i, 1) >= 0) {
+                        ybuf[z_col_pos_y_(i, 1)] = std::conj(z);
+                    }
+                }
+
+                /* transform non-zero y-lines */
+                fftw_t::execute(plan_backward_y_lines_[tid]);
+
+                /* transform x-rows and accumulate the density */
+                for (int y = 0; y < size(1); y++) {
+                    std::fill(xbuf, xbuf + size(0), 0);
+                    for (int ix = 0; ix < ntx; ix++) {
+                        xbuf[zcol_x_[ix]] = ybuf[ix * size(1) + y];
+                    }
+                    if (is_reduced) {
+                        fftw_t::execute(plan_backward_x_c2r_[tid]);
+                        for (int x = 0; x < size(0); x++) {
+                            rho[x + y * size(0)] += w * xbuf_r[x] * xbuf_r[x];
+                        }
+                    } else {
+                        fftw_t::execute(plan_backward_x_[tid]);
+                        for (int x = 0; x < size(0); x++) {
+                            rho[x + y * size(0)] += w * std::norm(xbuf[x]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /// Apply local operator to the z-columns of one function in a fused xy-step on the CPU.
+    /** Each xy-plane is transformed to real space, multiplied by V(r) and transformed back while it stays in the
+     *  per-thread buffers; the main FFT buffer is not touched. */
+    void apply_local_xy_cpu(complex_t* fft_buffer_aux__, T const* veff_r__)
+    {
+        PROFILE("sddk::FFT3D::apply_local_xy");
+
+        int size_xy = size(0) * size(1);
+
+        bool is_reduced = gvec_partition_->gvec().reduced();
+
+        int num_zcol = gvec_partition_->gvec().num_zcol();
+
+        /* number of x-coordinates touched by z-columns */
+        int ntx = static_cast<int>(zcol_x_.size());
+
+        #pragma omp parallel for schedule(static)
+        for (int iz = 0; iz < local_size_z(); iz++) {
+            int tid = omp_get_thread_num();
+
+            auto aux  = &fft_buffer_aux__[iz];
+            auto veff = &veff_r__[iz * size_xy];
+
+            /* compact buffer of y-lines */
+            auto ybuf = fftw_buffer_xy_[tid];
+            /* buffer of a single x-row */
+            auto xbuf = fftw_buffer_x_[tid];
+            auto xbuf_r = fftw_buffer_xy_r_[tid];
+
+            /* clear y-lines */
+            std::fill(ybuf, ybuf + ntx * size(1), 0);
+            /* load z-columns into proper location */
+            for (int i = 0; i < num_zcol; i++) {
+                auto z = aux[i * local_size_z()];
+                if (z_col_pos_y_(i, 0) >= 0) {
+                    ybuf[z_col_pos_y_(i, 0)] = z;
+                }
+                if (is_reduced && i && z_col_pos_y_(i, 1) >= 0) {
+                    ybuf[z_col_pos_y_(i, 1)] = std::conj(z);
+                }
+            }
+
+            /* transform non-zero y-lines */
+            fftw_t::execute(plan_backward_y_lines_[tid]);
+
+            /* transform each x-row to real space, apply V(r) and transform it back */
+            for (int y = 0; y < size(1); y++) {
+                std::fill(xbuf, xbuf + size(0), 0);
+                for (int ix = 0; ix < ntx; ix++) {
+                    xbuf[zcol_x_[ix]] = ybuf[ix * size(1) + y];
+                }
+                if (is_reduced) {
+                    fftw_t::execute(plan_backward_x_c2r_[tid]);
+                    for (int x = 0; x < size(0); x++) {
+                        xbuf_r[x] *= veff[x + y * size(0)];
+                    }
+                    fftw_t::execute(plan_forward_x_r2c_[tid]);
+                } else {
+                    fftw_t::execute(plan_backward_x_[tid]);
+                    for (int x = 0; x < size(0); x++) {
+                        xbuf[x] *= veff[x + y * size(0)];
+                    }
+                    fftw_t::execute(plan_forward_x_[tid]);
+                }
+                for (int ix = 0; ix < ntx; ix++) {
+                    ybuf[ix * size(1) + y] = xbuf[zcol_x_[ix]];
+                }
+            }
+
+            /* transform y-lines */
+            fftw_t::execute(plan_forward_y_lines_[tid]);
+
+            /* get z-columns */
+            for (int i = 0; i < num_zcol; i++) {
+                if (z_col_pos_y_(i, 0) >= 0) {
+                    aux[i * local_size_z()] = ybuf[z_col_pos_y_(i, 0)];
+                } else {
+                    aux[i * local_size_z()] = std::conj(ybuf[z_col_pos_y_(i, 1)]);
+                }
+            }
+        }
+    }
+
+    /// Apply local operator to the z-columns of two real functions in a fused xy-step on the CPU.
+    /** V(r) is real and is applied to the real and imaginary parts of the combined function at once. */
+    void apply_local_xy_cpu(complex_t* fft_buffer_aux1__, complex_t* fft_buffer_aux2__, T const* veff_r__)
+    {
+        PROFILE("sddk::FFT3D::apply_local_xy");
+
+        int size_xy = size(0) * size(1);
+
+        int num_zcol = gvec_partition_->gvec().num_zcol();
+
+        #pragma omp parallel for schedule(static)
+        for (int iz = 0; iz < local_size_z(); iz++) {
+            int tid = omp_get_thread_num();
+
+            auto aux1 = &fft_buffer_aux1__[iz];
+            auto aux2 = &fft_buffer_aux2__[iz];
+            auto veff = &veff_r__[iz * size_xy];
+            auto buf  = fftw_buffer_xy_[tid];
+
+            /* clear xy-buffer */
+            std::fill(buf, buf + size_xy, 0);
+
+            /* load first z-column into proper location */
+            buf[z_col_pos_(0, 0)] = aux1[0] + complex_t(0, 1) * aux2[0];
+
+            /* load remaining z-columns into proper location */
+            for (int i = 1; i < num_zcol; i++) {
+                /* {x, y} part */
+                buf[z_col_pos_(i, 0)] = aux1[i * local_size_z()] + complex_t(0, 1) * aux2[i * local_size_z()];
+                /* {-x, -y} part */
+                buf[z_col_pos_(i, 1)] = std::conj(aux1[i * local_size_z()]) +
+                                        complex_t(0, 1) * std::conj(aux2[i * local_size_z()]);
+            }
+
+            fftw_t::execute(plan_backward_xy_[tid]);
+
+            for (int i = 0; i < size_xy; i++) {
+                buf[i] *= veff[i];
+            }
+
+            fftw_t::execute(plan_forward_xy_[tid]);
+
+            /* get z-columns */
+            for (int i = 0; i < num_zcol; i++) {
+                aux1[i * local_size_z()] = T(0.5) * (buf[z_col_pos_(i, 0)] + std::conj(buf[z_col_pos_(i, 1)]));
+                aux2[i * local_size_z()] = complex_t(0, -0.5) * (buf[z_col_pos_(i, 0)] -
+                                                                 std::conj(buf[z_col_pos_(i, 1)]));
+            }
+        }
+    }
+
+    /// Multiply the real-space values of the FFT buffer by V(r).
+    void apply_local_r(T const* veff_r__)
+    {
+        if (pu_ == device_t::GPU) {
+            fft_buffer_.copy_to(memory_t::host);
+        }
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < local_size(); i++) {
+            fft_buffer_[i] *= veff_r__[i];
+        }
+        if (pu_ == device_t::GPU) {
+            fft_buffer_.copy_to(memory_t::device);
+        }
+    }
+
+    /// Choose the size of the block of z-columns and create the batched plans.
+    /** Blocks are limited by the size of L2 cache, but there should be at least one block per thread. */
+    void prepare_z_blocks()
+    {
+        int ncol = std::max(1, gvec_partition_->zcol_count_fft());
+
+        int nblk = std::max(omp_get_max_threads(), (ncol + zcol_block_size_max_ - 1) / zcol_block_size_max_);
+
+        zcol_block_size_ = std::max(1, (ncol + nblk - 1) / nblk);
+
+        int n[] = {size(2)};
+        for (int i = 0; i < omp_get_max_threads(); i++) {
+            auto ptr = (fftw_complex_t*)fftw_buffer_z_[i];
+            plan_forward_z_block_.push_back(fftw_t::plan_many_dft(1, n, zcol_block_size_, ptr, nullptr, 1, zcol_stride_,
+                                                                  ptr, nullptr, 1, zcol_stride_, FFTW_FORWARD,
+                                                                  fftw_flags_));
+            plan_backward_z_block_.push_back(fftw_t::plan_many_dft(1, n, zcol_block_size_, ptr, nullptr, 1,
+                                                                   zcol_stride_, ptr, nullptr, 1, zcol_stride_,
+                                                                   FFTW_BACKWARD, fftw_flags_));
+        }
+    }
+
+    /// Create the plans of the pruned z-transformations which are used by the local z-columns.
+    /** The plans are kept for the lifetime of the object, so only the pruned sizes which were not used by any of the
+     *  previous partitions are planned. */
+    void prepare_z_pruned_plans(int ncol__)
+    {
+        for (int i = 0; i < ncol__; i++) {
+            int k = zcol_prune_idx_[i];
+            if (k < 0 || plan_forward_z_pruned_[0][k]) {
+                continue;
+            }
+            int m   = z_prune_size_[k];
+            int n[] = {m};
+            for (int t = 0; t < omp_get_max_threads(); t++) {
+                auto ptr = (fftw_complex_t*)fftw_buffer_z_pruned_[t];
+                plan_forward_z_pruned_[t][k] = fftw_t::plan_many_dft(1, n, size(2) / m, ptr, nullptr, 1, m, ptr,
+                                                                     nullptr, 1, m, FFTW_FORWARD, fftw_flags_);
+                plan_backward_z_pruned_[t][k] = fftw_t::plan_many_dft(1, n, size(2) / m, ptr, nullptr, 1, m, ptr,
+                                                                      nullptr, 1, m, FFTW_BACKWARD, fftw_flags_);
+            }
+        }
+    }
+
+    /// Exchange the layout of the current G-vector partition with the cached layout.
+    void swap_layout(layout_t& layout__)
+    {
+        std::swap(a2a_send, layout__.a2a_send);
+        std::swap(a2a_recv, layout__.a2a_recv);
+        std::swap(a2a_chunk_zcol_, layout__.a2a_chunk_zcol);
+        std::swap(a2a_send_chunk_, layout__.a2a_send_chunk);
+        std::swap(a2a_recv_chunk_, layout__.a2a_recv_chunk);
+        std::swap(a2a_neighbor_layout_, layout__.a2a_neighbor);
+        std::swap(a2a_peers_, layout__.a2a_peers);
+        std::swap(a2a_graph_comm_, layout__.a2a_graph_comm);
+        std::swap(z_col_pos_, layout__.z_col_pos);
+        std::swap(pencil_send_zcol_, layout__.pencil_send_zcol);
+        std::swap(pencil_send_zcol_fwd_, layout__.pencil_send_zcol_fwd);
+        std::swap(pencil_recv_zcol_, layout__.pencil_recv_zcol);
+        std::swap(pencil_recv_zcol_fwd_, layout__.pencil_recv_zcol_fwd);
+        std::swap(zcol_x_, layout__.zcol_x);
+        std::swap(z_col_pos_y_, layout__.z_col_pos_y);
+        std::swap(plan_backward_y_lines_, layout__.plan_backward_y_lines);
+        std::swap(plan_forward_y_lines_, layout__.plan_forward_y_lines);
+        std::swap(zcol_block_size_, layout__.zcol_block_size);
+        std::swap(plan_backward_z_block_, layout__.plan_backward_z_block);
+        std::swap(plan_forward_z_block_, layout__.plan_forward_z_block);
+        std::swap(zcol_gvec_pos_, layout__.zcol_gvec_pos);
+        std::swap(zcol_gvec_pos_x0y0_, layout__.zcol_gvec_pos_x0y0);
+        std::swap(zcol_prune_idx_, layout__.zcol_prune_idx);
+        std::swap(zcol_cost_, layout__.zcol_cost);
+        std::swap(map_gvec_to_fft_buffer_, layout__.map_gvec_to_fft_buffer);
+        std::swap(map_gvec_to_fft_buffer_x0y0_, layout__.map_gvec_to_fft_buffer_x0y0);
+    }
+
+    /// Destroy FFTW plans of the cached layout.
+    static void destroy_layout_plans(layout_t& layout__)
+    {
+        for (size_t i = 0; i < layout__.plan_forward_z_block.size(); i++) {
+            fftw_t::destroy_plan(layout__.plan_forward_z_block[i]);
+            fftw_t::destroy_plan(layout__.plan_backward_z_block[i]);
+        }
+        for (size_t i = 0; i < layout__.plan_forward_y_lines.size(); i++) {
+            fftw_t::destroy_plan(layout__.plan_forward_y_lines[i]);
+            fftw_t::destroy_plan(layout__.plan_backward_y_lines[i]);
+        }
+    }
+
+    /// Move the layout of the current G-vector partition to the cache.
+    void store_layout()
+    {
+        layout_cache_.emplace_front();
+        layout_cache_.front().gvec_partition_id = gvec_partition_->id();
+        swap_layout(layout_cache_.front());
+
+        /* remove the least recently used layouts */
+        while (static_cast<int>(layout_cache_.size()) > layout_cache_size_) {
+            destroy_layout_plans(layout_cache_.back());
+            layout_cache_.pop_back();
+        }
+    }
+
+    /// Restore the layout of a G-vector partition from the cache.
+    /** A layout which was created with a different setting of the neighborhood exchange or with a different
+     *  number of chunks of the pipelined z-transformation is removed from the cache.
+     *  \return True if the layout was found. */
+    bool restore_layout(Gvec_partition const& gvp__)
+    {
+        /* number of chunks of the layout which would be created now */
+        size_t num_chunks = (num_a2a_chunks_ > 1 && num_ranks_xy_ == 1) ? num_a2a_chunks_ : 0;
+        for (auto it = layout_cache_.begin(); it != layout_cache_.end(); it++) {
+            if (it->gvec_partition_id == gvp__.id()) {
+                if (it->a2a_neighbor != a2a_neighbor_ || it->a2a_chunk_zcol.size() != num_chunks) {
+                    destroy_layout_plans(*it);
+                    layout_cache_.erase(it);
+                    return false;
+                }
+                swap_layout(*it);
+                layout_cache_.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Create the layout of the FFT for a G-vector partition.
+    void prepare_layout(Gvec_partition const& gvp__)
+    {
+        PROFILE("sddk::FFT3D::prepare_layout");
+
+        /* create offses and counts for mpi a2a call; done for direction=1 (scattering of z-columns);
+           for direction=-1 send and recieve dimensions are interchanged */
+        int rank = comm_.rank();
+        if (num_ranks_xy_ == 1) {
+            a2a_send = block_data_descriptor(comm_.size());
+            a2a_recv = block_data_descriptor(comm_.size());
+            for (int r = 0; r < comm_.size(); r++) {
+                a2a_send.counts[r] = spl_z_.local_size(r) * gvec_partition_->zcol_count_fft(rank);
+                a2a_recv.counts[r] = spl_z_.local_size(rank) * gvec_partition_->zcol_count_fft(r);
+            }
+            a2a_recv.calc_offsets();
+        } else {
+            /* in case of pencil decomposition z-sticks are packed by z-slabs before the exchange */
+            a2a_send = block_data_descriptor(spl_z_.num_ranks());
+            for (int r = 0; r < spl_z_.num_ranks(); r++) {
+                a2a_send.counts[r] = spl_z_.local_size(r) * gvec_partition_->zcol_count_fft(rank);
+            }
+        }
+        a2a_send.calc_offsets();
+
+        /* graph of the ranks with non-zero counts; the send count to r is equal to the receive count of r from
+           this rank, so the list of peers is symmetric and the same graph serves both directions */
+        a2a_neighbor_layout_ = a2a_neighbor_;
+        a2a_peers_.clear();
+        a2a_graph_comm_ = Communicator();
+        if (a2a_neighbor_ && num_ranks_xy_ == 1 && comm_.size() > 1) {
+            for (int r = 0; r < comm_.size(); r++) {
+                if (a2a_send.counts[r] || a2a_recv.counts[r]) {
+                    a2a_peers_.push_back(r);
+                }
+            }
+            a2a_graph_comm_ = comm_.dist_graph_create_adjacent(a2a_peers_, a2a_peers_);
+        }
+
+        /* split local z-columns of each rank into chunks for the pipelined z-transformation */
+        a2a_chunk_zcol_.clear();
+        a2a_send_chunk_.clear();
+        a2a_recv_chunk_.clear();
+        if (num_a2a_chunks_ > 1 && num_ranks_xy_ == 1) {
+            a2a_chunk_zcol_ = std::vector<std::pair<int, int>>(num_a2a_chunks_);
+            a2a_send_chunk_ = std::vector<block_data_descriptor>(num_a2a_chunks_, block_data_descriptor(comm_.size()));
+            a2a_recv_chunk_ = std::vector<block_data_descriptor>(num_a2a_chunks_, block_data_descriptor(comm_.size()));
+            /* first local column of a chunk c on rank r */
+            auto chunk_offset = [&](int r, int c) {
+                return static_cast<int>((static_cast<long>(gvec_partition_->zcol_count_fft(r)) * c) / num_a2a_chunks_);
+            };
+            for (int c = 0; c < num_a2a_chunks_; c++) {
+                a2a_chunk_zcol_[c] = std::make_pair(chunk_offset(rank, c), chunk_offset(rank, c + 1));
+                for (int r = 0; r < comm_.size(); r++) {
+                    int ncol_send = chunk_offset(rank, c + 1) - chunk_offset(rank, c);
+                    a2a_send_chunk_[c].counts[r]  = spl_z_.local_size(r) * ncol_send;
+                    a2a_send_chunk_[c].offsets[r] = a2a_send.offsets[r] + spl_z_.local_size(r) * chunk_offset(rank, c);
+                    int ncol_recv = chunk_offset(r, c + 1) - chunk_offset(r, c);
+                    a2a_recv_chunk_[c].counts[r]  = spl_z_.local_size(rank) * ncol_recv;
+                    a2a_recv_chunk_[c].offsets[r] = a2a_recv.offsets[r] + spl_z_.local_size(rank) * chunk_offset(r, c);
+                }
+            }
+        }
+
+        /* in case of reduced G-vector set we need to store a position of -x,-y column as well */
+        int nc = gvp__.gvec().reduced() ? 2 : 1;
+
+        utils::timer t1("sddk::FFT3D::prepare|cpu");
+        /* get positions of z-columns in xy plane */
+        z_col_pos_ = mdarray<int, 2>(gvp__.gvec().num_zcol(), nc, memory_t::host, "FFT3D.z_col_pos_");
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < gvp__.gvec().num_zcol(); i++) {
+            int icol = gvp__.idx_zcol<index_domain_t::global>(i);
+            int x    = coord_by_freq<0>(gvp__.gvec().zcol(icol).x);
+            int y    = coord_by_freq<1>(gvp__.gvec().zcol(icol).y);
+            assert(x >= 0 && x < size(0));
+            assert(y >= 0 && y < size(1));
+            z_col_pos_(i, 0) = x + y * size(0);
+            if (gvp__.gvec().reduced()) {
+                x = coord_by_freq<0>(-gvp__.gvec().zcol(icol).x);
+                y = coord_by_freq<1>(-gvp__.gvec().zcol(icol).y);
+                assert(x >= 0 && x < size(0));
+                assert(y >= 0 && y < size(1));
+                z_col_pos_(i, 1) = x + y * size(0);
+            }
+        }
+        if (num_ranks_xy_ > 1) {
+            prepare_pencil();
+        }
+        if (!fftw_wisdom_file_.empty()) {
+            load_fftw_wisdom<T>(fftw_wisdom_file_);
+        }
+        if (pu_ == device_t::CPU && num_ranks_xy_ == 1) {
+            prepare_y_lines();
+        }
+
+        prepare_z_blocks();
+
+        /* positions of G-vectors inside z-columns */
+        zcol_gvec_pos_ = mdarray<int, 1>(gvp__.gvec_count_fft() + 1, memory_t::host, "FFT3D.zcol_gvec_pos_");
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < gvp__.zcol_count_fft(); i++) {
+            int icol = gvp__.idx_zcol<index_domain_t::local>(i);
+            for (size_t j = 0; j < gvp__.gvec().zcol(icol).z.size(); j++) {
+                zcol_gvec_pos_[gvp__.zcol_offs(icol) + j] = coord_by_freq<2>(gvp__.gvec().zcol(icol).z[j]);
+            }
+        }
+        if (gvp__.gvec().reduced()) {
+            zcol_gvec_pos_x0y0_ = mdarray<int, 1>(gvp__.gvec().zcol(0).z.size(), memory_t::host,
+                                                  "FFT3D.zcol_gvec_pos_x0y0_");
+            for (size_t j = 0; j < gvp__.gvec().zcol(0).z.size(); j++) {
+                zcol_gvec_pos_x0y0_[j] = coord_by_freq<2>(-gvp__.gvec().zcol(0).z[j]);
+            }
+        }
+
+        /* sizes of the pruned z-transforms; the {0,0,z} column of the reduced set is always fully transformed */
+        zcol_prune_idx_ = mdarray<int, 1>(gvp__.zcol_count_fft() + 1, memory_t::host, "FFT3D.zcol_prune_idx_");
+        for (int i = 0; i < gvp__.zcol_count_fft(); i++) {
+            int icol = gvp__.idx_zcol<index_domain_t::local>(i);
+            auto& z  = gvp__.gvec().zcol(icol).z;
+
+            zcol_prune_idx_[i] = -1;
+            if (z.empty() || (gvp__.gvec().reduced() && !icol)) {
+                continue;
+            }
+            int span = *std::max_element(z.begin(), z.end()) - *std::min_element(z.begin(), z.end()) + 1;
+            for (int k = 0; k < static_cast<int>(z_prune_size_.size()); k++) {
+                if (z_prune_size_[k] >= span) {
+                    zcol_prune_idx_[i] = k;
+                    break;
+                }
+            }
+        }
+        if (pu_ == device_t::CPU) {
+            prepare_z_pruned_plans(gvp__.zcol_count_fft());
+        }
+        if (!fftw_wisdom_file_.empty()) {
+            store_fftw_wisdom<T>(fftw_wisdom_file_);
+        }
+
+        /* estimated cost of the z-transformation of local columns */
+        zcol_cost_ = mdarray<double, 1>(gvp__.zcol_count_fft() + 1, memory_t::host, "FFT3D.zcol_cost_");
+        zcol_cost_[0] = 0;
+        for (int i = 0; i < gvp__.zcol_count_fft(); i++) {
+            int icol = gvp__.idx_zcol<index_domain_t::local>(i);
+            int ngv  = static_cast<int>(gvp__.gvec().zcol(icol).z.size());
+            double N = size(2);
+            double c = N * std::log2(N);
+            if (zcol_prune_idx_[i] >= 0) {
+                double M = z_prune_size_[zcol_prune_idx_[i]];
+                c = ngv * (N / M) + N * std::log2(M);
+            }
+            zcol_cost_[i + 1] = zcol_cost_[i] + c + N + ngv;
+        }
+        t1.stop();
+
+        /* stride of z-columns in the batched FFT buffer */
+        int zstride = (pu_ == device_t::GPU) ? size(2) : zcol_stride_;
+
+        map_gvec_to_fft_buffer_ = mdarray<int, 1>(gvp__.gvec_count_fft() + 1, memory_t::host,
+                                                  "FFT3D.map_gvec_to_fft_buffer_");
+        /* loop over local set of columns */
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < gvp__.zcol_count_fft(); i++) {
+            /* global index of z-column */
+            int icol = gvec_partition_->idx_zcol<index_domain_t::local>(i);
+            /* loop over z-colmn */
+            for (size_t j = 0; j < gvp__.gvec().zcol(icol).z.size(); j++) {
+                /* local index of the G-vector */
+                size_t ig = gvp__.zcol_offs(icol) + j;
+                /* position of PW harmonic with index ig inside batched FFT buffer */
+                map_gvec_to_fft_buffer_[ig] = i * zstride + zcol_gvec_pos_[ig];
+            }
+        }
+
+        if (pu_ == device_t::GPU) {
+            map_gvec_to_fft_buffer_.allocate(memory_t::device).copy_to(memory_t::device);
+
+            /* for the rank that stores {x=0,y=0} column we need to create a small second mapping */
+            if (gvp__.gvec().reduced() && comm_.rank() == 0) {
+                map_gvec_to_fft_buffer_x0y0_ = mdarray<int, 1>(gvp__.gvec().zcol(0).z.size(), memory_t::host,
+                                                               "FFT3D.map_gvec_to_fft_buffer_x0y0_");
+                for (size_t j = 0; j < gvp__.gvec().zcol(0).z.size(); j++) {
+                    int z = coord_by_freq<2>(-gvp__.gvec().zcol(0).z[j]);
+                    assert(z >= 0 && z < size(2));
+                    map_gvec_to_fft_buffer_x0y0_[j] = z;
+                }
+                map_gvec_to_fft_buffer_x0y0_.allocate(memory_t::device).copy_to(memory_t::device);
+            }
+            z_col_pos_.allocate(memory_t::device).copy_to(memory_t::device);
+        }
+    }
+
+    /// Find x-coordinates touched by z-columns and create the plans for the transformation of y-lines.
+    void prepare_y_lines()
     {
-        PROFILE("sddk::FFT3D::transform_xy");
+        bool is_reduced = gvec_partition_->gvec().reduced();
 
-        if (!gvec_partition_->gvec().reduced()) {
-            TERMINATE("reduced set of G-vectors is required");
-        }
+        int nc = is_reduced ? 2 : 1;
 
-        int size_xy = size(0) * size(1);
+        /* in case of real function only half of the x-range is needed */
+        int nx = is_reduced ? size(0) / 2 + 1 : size(0);
 
-#if defined(__GPU)
-#if defined(__CUDA)
-        if (pu_ == device_t::GPU) {
-            /* stream #0 will be doing cuFFT */
-            switch (direction) {
-                case 1: {
-                    /* srteam #0 unpacks z-columns into proper position of FFT buffer */
-                    unpack_z_cols_2_gpu(fft_buffer_aux1__.at(memory_t::device),
-                                        fft_buffer_aux2__.at(memory_t::device),
-                                        fft_buffer_.at(memory_t::device), size(0), size(1), local_size_z(),
-                                        gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device), acc_fft_stream_id_);
-                    /* stream #0 executes FFT */
-                    cufft::backward_transform(acc_fft_plan_xy_backward_, fft_buffer_.at(memory_t::device));
-                    break;
-                }
-                case -1: {
-                    /* stream #0 executes FFT */
-                    cufft::forward_transform(acc_fft_plan_xy_forward_, fft_buffer_.at(memory_t::device));
-                    /* stream #0 packs z-columns */
-                    pack_z_cols_2_gpu(fft_buffer_aux1__.at(memory_t::device),
-                                      fft_buffer_aux2__.at(memory_t::device),
-                                      fft_buffer_.at(memory_t::device), size(0), size(1), local_size_z(),
-                                      gvec_partition_->gvec().num_zcol(), z_col_pos_.at(memory_t::device), acc_fft_stream_id_);
-                    break;
+        std::vector<int> idx_x(size(0), -1);
+        for (int i = 0; i < gvec_partition_->gvec().num_zcol(); i++) {
+            for (int j = 0; j < nc; j++) {
+                int x = z_col_pos_(i, j) % size(0);
+                if (x < nx) {
+                    idx_x[x] = 1;
                 }
             }
-            acc::sync_stream(stream_id(acc_fft_stream_id_));
         }
-#endif
-#endif
+        zcol_x_.clear();
+        for (int x = 0; x < size(0); x++) {
+            if (idx_x[x] != -1) {
+                idx_x[x] = static_cast<int>(zcol_x_.size());
+                zcol_x_.push_back(x);
+            }
+        }
 
-        if (pu_ == device_t::CPU) {
-            #pragma omp parallel
-            {
-                int tid = omp_get_thread_num();
-                #pragma omp for schedule(static)
-                for (int iz = 0; iz < local_size_z(); iz++) {
-                    switch (direction) {
-                        case 1: {
-                            /* clear xy-buffer */
-                            std::fill(fftw_buffer_xy_[tid], fftw_buffer_xy_[tid] + size_xy, 0);
+        z_col_pos_y_ = mdarray<int, 2>(gvec_partition_->gvec().num_zcol(), nc, memory_t::host, "FFT3D.z_col_pos_y_");
+        for (int i = 0; i < gvec_partition_->gvec().num_zcol(); i++) {
+            for (int j = 0; j < nc; j++) {
+                int x = z_col_pos_(i, j) % size(0);
+                int y = z_col_pos_(i, j) / size(0);
+                z_col_pos_y_(i, j) = (x < nx) ? idx_x[x] * size(1) + y : -1;
+            }
+        }
 
-                            /* load first z-column into proper location */
-                            fftw_buffer_xy_[tid][z_col_pos_(0, 0)] =
-                                fft_buffer_aux1__[iz] + double_complex(0, 1) * fft_buffer_aux2__[iz];
+        /* batched plans for the y-lines which are stored one after another */
+        int ntx = static_cast<int>(zcol_x_.size());
+        int n[] = {size(1)};
+        for (int i = 0; i < omp_get_max_threads(); i++) {
+            auto ptr = (fftw_complex_t*)fftw_buffer_xy_[i];
+            plan_forward_y_lines_.push_back(fftw_t::plan_many_dft(1, n, ntx, ptr, nullptr, 1, size(1), ptr, nullptr, 1,
+                                                                  size(1), FFTW_FORWARD, fftw_flags_));
+            plan_backward_y_lines_.push_back(fftw_t::plan_many_dft(1, n, ntx, ptr, nullptr, 1, size(1), ptr, nullptr, 1,
+                                                                   size(1), FFTW_BACKWARD, fftw_flags_));
+        }
+    }
 
-                            /* load remaining z-columns into proper location */
-                            for (int i = 1; i < gvec_partition_->gvec().num_zcol(); i++) {
-                                /* {x, y} part */
-                                fftw_buffer_xy_[tid][z_col_pos_(i, 0)] =
-                                    fft_buffer_aux1__[iz + i * local_size_z()] +
-                                    double_complex(0, 1) * fft_buffer_aux2__[iz + i * local_size_z()];
+    /// Position of z-columns in the pencil decomposition.
+    /** Each rank computes the lists of z-columns for all ranks of the FFT communicator, so no communication
+     *  is needed. */
+    void prepare_pencil()
+    {
+        PROFILE("sddk::FFT3D::prepare_pencil");
 
-                                /* {-x, -y} part */
-                                fftw_buffer_xy_[tid][z_col_pos_(i, 1)] =
-                                    std::conj(fft_buffer_aux1__[iz + i * local_size_z()]) +
-                                    double_complex(0, 1) * std::conj(fft_buffer_aux2__[iz + i * local_size_z()]);
-                            }
+        int rank_xy = comm_.rank() % num_ranks_xy_;
 
-                            /* execute local FFT transform */
-                            fftw_execute(plan_backward_xy_[tid]);
+        bool is_reduced = gvec_partition_->gvec().reduced();
 
-                            /* copy xy plane to the main FFT buffer */
-                            std::copy(fftw_buffer_xy_[tid], fftw_buffer_xy_[tid] + size_xy, &fft_buffer_[iz * size_xy]);
+        pencil_send_zcol_     = std::vector<std::vector<int>>(num_ranks_xy_);
+        pencil_send_zcol_fwd_ = std::vector<std::vector<int>>(num_ranks_xy_);
+        pencil_recv_zcol_     = std::vector<std::vector<std::pair<int, bool>>>(comm_.size());
+        pencil_recv_zcol_fwd_ = std::vector<std::vector<int>>(comm_.size());
 
-                            break;
+        /* index of the column in the FFT-friendly distribution */
+        int i{0};
+        for (int r = 0; r < comm_.size(); r++) {
+            for (int j = 0; j < gvec_partition_->zcol_count_fft(r); j++) {
+                int icol = gvec_partition_->idx_zcol<index_domain_t::global>(i);
+                /* column with {x,y} = {0,0} has no mirror */
+                for (int k = 0; k < ((is_reduced && icol) ? 2 : 1); k++) {
+                    int x = z_col_pos_(i, k) % size(0);
+                    int y = z_col_pos_(i, k) / size(0);
+                    /* xy-rank which stores this column */
+                    int rxy = spl_x_.local_rank(x);
+                    if (r == comm_.rank()) {
+                        pencil_send_zcol_[rxy].push_back(j);
+                        if (k == 0) {
+                            pencil_send_zcol_fwd_[rxy].push_back(j);
                         }
-                        case -1: {
-                            /* copy xy plane from the main FFT buffer */
-                            std::copy(&fft_buffer_[iz * size_xy], &fft_buffer_[iz * size_xy] + size_xy,
-                                      fftw_buffer_xy_[tid]);
+                    }
+                    if (rxy == rank_xy) {
+                        int pos = (x - spl_x_.global_offset()) * size(1) + y;
+                        pencil_recv_zcol_[r].push_back(std::make_pair(pos, k == 1));
+                        if (k == 0) {
+                            pencil_recv_zcol_fwd_[r].push_back(pos);
+                        }
+                    }
+                }
+                i++;
+            }
+        }
 
-                            /* execute local FFT transform */
-                            fftw_execute(plan_forward_xy_[tid]);
+        /* size of the buffers for the exchange of z-columns and for the transposition */
+        size_t sz = std::max(local_size(), local_size_z() * spl_x_.local_size() * size(1));
+        size_t sz_send{0};
+        size_t sz_recv{0};
+        for (int r = 0; r < comm_.size(); r++) {
+            sz_send += pencil_send_zcol_[r % num_ranks_xy_].size() * spl_z_.local_size(r / num_ranks_xy_);
+            sz_recv += pencil_recv_zcol_[r].size() * local_size_z();
+        }
+        /* buffers are never empty, even if this rank has no x- or y-coordinates */
+        sz = std::max(sz, std::max(sz_send, sz_recv)) + 1;
+        if (fft_buffer_pencil_send_.size() < sz) {
+            fft_buffer_pencil_send_ =
+                allocate_work_array<complex_t, 1>(memory_t::host, "FFT3D.fft_buffer_pencil_send_", sz);
+            fft_buffer_pencil_recv_ =
+                allocate_work_array<complex_t, 1>(memory_t::host, "FFT3D.fft_buffer_pencil_recv_", sz);
+        }
+        sz = local_size_z() * spl_x_.local_size() * size(1) + 1;
+        if (fft_buffer_pencil_y_.size() < sz) {
+            fft_buffer_pencil_y_ = allocate_work_array<complex_t, 1>(memory_t::host, "FFT3D.fft_buffer_pencil_y_", sz);
+        }
+    }
 
-                            /* get z-columns */
-                            for (int i = 0; i < gvec_partition_->gvec().num_zcol(); i++) {
-                                fft_buffer_aux1__[iz + i * local_size_z()] =
-                                    0.5 * (fftw_buffer_xy_[tid][z_col_pos_(i, 0)] +
-                                           std::conj(fftw_buffer_xy_[tid][z_col_pos_(i, 1)]));
+    /// Transformation of a single function in the pencil decomposition.
+    template <int direction>
+    void transform_pencil(complex_t* data__)
+    {
+        PROFILE("sddk::FFT3D::transform_pencil");
+
+        auto& comm_xy = mpi_grid_->communicator(1 << 1);
+
+        /* local number of x-coordinates of y-lines */
+        int nx = spl_x_.local_size();
+        /* local number of y-coordinates of x-rows */
+        int ny = local_size_y();
+        int nz = local_size_z();
+
+        auto aux  = fft_buffer_aux1_.at(memory_t::host);
+        auto sbuf = fft_buffer_pencil_send_.at(memory_t::host);
+        auto rbuf = fft_buffer_pencil_recv_.at(memory_t::host);
+        auto ybuf = fft_buffer_pencil_y_.at(memory_t::host);
+
+        /* counts and offsets of the z-column exchange; done for direction=1, for direction=-1 send and
+           recieve dimensions are interchanged */
+        auto& send_zcol = (direction == 1) ? pencil_send_zcol_ : pencil_send_zcol_fwd_;
+        block_data_descriptor a2a_zy_send(comm_.size());
+        block_data_descriptor a2a_zy_recv(comm_.size());
+        for (int r = 0; r < comm_.size(); r++) {
+            int ncol = static_cast<int>((direction == 1) ? pencil_recv_zcol_[r].size() : pencil_recv_zcol_fwd_[r].size());
+            a2a_zy_send.counts[r] = static_cast<int>(send_zcol[r % num_ranks_xy_].size()) *
+                                    spl_z_.local_size(r / num_ranks_xy_);
+            a2a_zy_recv.counts[r] = ncol * nz;
+        }
+        a2a_zy_send.calc_offsets();
+        a2a_zy_recv.calc_offsets();
+
+        /* counts and offsets of the transposition between y-lines and x-rows */
+        block_data_descriptor a2a_yx_send(num_ranks_xy_);
+        block_data_descriptor a2a_yx_recv(num_ranks_xy_);
+        for (int q = 0; q < num_ranks_xy_; q++) {
+            a2a_yx_send.counts[q] = nz * nx * spl_y_.local_size(q);
+            a2a_yx_recv.counts[q] = nz * spl_x_.local_size(q) * ny;
+        }
+        a2a_yx_send.calc_offsets();
+        a2a_yx_recv.calc_offsets();
 
-                                fft_buffer_aux2__[iz + i * local_size_z()] =
-                                    double_complex(0, -0.5) * (fftw_buffer_xy_[tid][z_col_pos_(i, 0)] -
-                                                               std::conj(fftw_buffer_xy_[tid][z_col_pos_(i, 1)]));
-                            }
+        switch (direction) {
+            case 1: {
+                transform_z_serial_cpu<direction>(1, &data__, aux);
 
-                            break;
+                /* pack z-sticks for the ranks which store the corresponding z-slab and x-range */
+                #pragma omp parallel for schedule(static)
+                for (int r = 0; r < comm_.size(); r++) {
+                    int rz  = r / num_ranks_xy_;
+                    int lsz = spl_z_.local_size(rz);
+                    auto& cols = send_zcol[r % num_ranks_xy_];
+                    for (int k = 0; k < static_cast<int>(cols.size()); k++) {
+                        auto ptr = &aux[a2a_send.offsets[rz] + cols[k] * lsz];
+                        std::copy(ptr, ptr + lsz, &sbuf[a2a_zy_send.offsets[r] + k * lsz]);
+                    }
+                }
+                utils::timer t1("sddk::FFT3D::transform_pencil|comm");
+                alltoall_z(sbuf, a2a_zy_send.counts.data(), a2a_zy_send.offsets.data(), rbuf,
+                           a2a_zy_recv.counts.data(), a2a_zy_recv.offsets.data());
+                t1.stop();
+
+                /* unpack z-sticks into y-lines */
+                std::fill(ybuf, ybuf + nz * nx * size(1), 0);
+                #pragma omp parallel for schedule(static)
+                for (int r = 0; r < comm_.size(); r++) {
+                    auto& cols = pencil_recv_zcol_[r];
+                    for (int k = 0; k < static_cast<int>(cols.size()); k++) {
+                        auto ptr = &rbuf[a2a_zy_recv.offsets[r] + k * nz];
+                        for (int iz = 0; iz < nz; iz++) {
+                            ybuf[iz * nx * size(1) + cols[k].first] = cols[k].second ? std::conj(ptr[iz]) : ptr[iz];
                         }
-                        default: {
-                            TERMINATE("wrong direction");
+                    }
+                }
+
+                /* transform y-lines and pack them for the transposition */
+                #pragma omp parallel for schedule(static)
+                for (int k = 0; k < nz * nx; k++) {
+                    int tid = omp_get_thread_num();
+                    std::copy(&ybuf[k * size(1)], &ybuf[k * size(1)] + size(1), fftw_buffer_y_[tid]);
+                    fftw_t::execute(plan_backward_y_[tid]);
+                    for (int q = 0; q < num_ranks_xy_; q++) {
+                        int nyq  = spl_y_.local_size(q);
+                        auto ptr = &fftw_buffer_y_[tid][spl_y_.global_offset(q)];
+                        std::copy(ptr, ptr + nyq, &sbuf[a2a_yx_send.offsets[q] + k * nyq]);
+                    }
+                }
+                utils::timer t2("sddk::FFT3D::transform_pencil|comm");
+                comm_xy.alltoall(sbuf, a2a_yx_send.counts.data(), a2a_yx_send.offsets.data(), rbuf,
+                                 a2a_yx_recv.counts.data(), a2a_yx_recv.offsets.data());
+                t2.stop();
+
+                /* collect and transform x-rows */
+                #pragma omp parallel for schedule(static)
+                for (int k = 0; k < nz * ny; k++) {
+                    int tid = omp_get_thread_num();
+                    int iz  = k / ny;
+                    int iy  = k % ny;
+                    for (int q = 0; q < num_ranks_xy_; q++) {
+                        int nxq = spl_x_.local_size(q);
+                        for (int ix = 0; ix < nxq; ix++) {
+                            fftw_buffer_x_[tid][spl_x_.global_offset(q) + ix] =
+                                rbuf[a2a_yx_recv.offsets[q] + (iz * nxq + ix) * ny + iy];
+                        }
+                    }
+                    fftw_t::execute(plan_backward_x_[tid]);
+                    std::copy(fftw_buffer_x_[tid], fftw_buffer_x_[tid] + size(0), &fft_buffer_[k * size(0)]);
+                }
+                break;
+            }
+            case -1: {
+                /* transform x-rows and pack them for the transposition */
+                #pragma omp parallel for schedule(static)
+                for (int k = 0; k < nz * ny; k++) {
+                    int tid = omp_get_thread_num();
+                    int iz  = k / ny;
+                    int iy  = k % ny;
+                    std::copy(&fft_buffer_[k * size(0)], &fft_buffer_[k * size(0)] + size(0), fftw_buffer_x_[tid]);
+                    fftw_t::execute(plan_forward_x_[tid]);
+                    for (int q = 0; q < num_ranks_xy_; q++) {
+                        int nxq = spl_x_.local_size(q);
+                        for (int ix = 0; ix < nxq; ix++) {
+                            sbuf[a2a_yx_recv.offsets[q] + (iz * nxq + ix) * ny + iy] =
+                                fftw_buffer_x_[tid][spl_x_.global_offset(q) + ix];
+                        }
+                    }
+                }
+                utils::timer t1("sddk::FFT3D::transform_pencil|comm");
+                comm_xy.alltoall(sbuf, a2a_yx_recv.counts.data(), a2a_yx_recv.offsets.data(), rbuf,
+                                 a2a_yx_send.counts.data(), a2a_yx_send.offsets.data());
+                t1.stop();
+
+                /* collect and transform y-lines */
+                #pragma omp parallel for schedule(static)
+                for (int k = 0; k < nz * nx; k++) {
+                    int tid = omp_get_thread_num();
+                    for (int q = 0; q < num_ranks_xy_; q++) {
+                        int nyq  = spl_y_.local_size(q);
+                        auto ptr = &rbuf[a2a_yx_send.offsets[q] + k * nyq];
+                        std::copy(ptr, ptr + nyq, &fftw_buffer_y_[tid][spl_y_.global_offset(q)]);
+                    }
+                    fftw_t::execute(plan_forward_y_[tid]);
+                    std::copy(fftw_buffer_y_[tid], fftw_buffer_y_[tid] + size(1), &ybuf[k * size(1)]);
+                }
+
+                /* pack z-sticks for the ranks which store the z-columns */
+                #pragma omp parallel for schedule(static)
+                for (int r = 0; r < comm_.size(); r++) {
+                    auto& cols = pencil_recv_zcol_fwd_[r];
+                    for (int k = 0; k < static_cast<int>(cols.size()); k++) {
+                        auto ptr = &sbuf[a2a_zy_recv.offsets[r] + k * nz];
+                        for (int iz = 0; iz < nz; iz++) {
+                            ptr[iz] = ybuf[iz * nx * size(1) + cols[k]];
                         }
                     }
                 }
+                utils::timer t2("sddk::FFT3D::transform_pencil|comm");
+                alltoall_z(sbuf, a2a_zy_recv.counts.data(), a2a_zy_recv.offsets.data(), rbuf,
+                           a2a_zy_send.counts.data(), a2a_zy_send.offsets.data());
+                t2.stop();
+
+                /* unpack z-sticks */
+                #pragma omp parallel for schedule(static)
+                for (int r = 0; r < comm_.size(); r++) {
+                    int rz  = r / num_ranks_xy_;
+                    int lsz = spl_z_.local_size(rz);
+                    auto& cols = send_zcol[r % num_ranks_xy_];
+                    for (int k = 0; k < static_cast<int>(cols.size()); k++) {
+                        auto ptr = &rbuf[a2a_zy_send.offsets[r] + k * lsz];
+                        std::copy(ptr, ptr + lsz, &aux[a2a_send.offsets[rz] + cols[k] * lsz]);
+                    }
+                }
+
+                transform_z_serial_cpu<direction>(1, &data__, aux);
+                break;
+            }
+            default: {
+                TERMINATE("wrong direction");
             }
         }
     }
 
   public:
     /// Constructor.
-    FFT3D(std::array<int, 3> initial_dims__, Communicator const& comm__, device_t pu__)
-        : FFT3D_grid(initial_dims__)
+    /** FFTW plans are created with the given planning rigor. In case of measured plans the wisdom for this
+     *  grid and number of threads is loaded first and then saved at sirius::finalize(), so that the
+     *  expensive planning is done only once. */
+    FFT3D_base(std::array<int, 3> initial_dims__, Communicator const& comm__, device_t pu__,
+               fftw_planner_t planner__ = fftw_planner())
+        : FFT3D_base(initial_dims__, comm__, pu__, 1, planner__)
+    {
+    }
+
+    /// Constructor of the FFT with pencil decomposition.
+    /** The ranks of the communicator are arranged in a {comm.size() / num_ranks_xy, num_ranks_xy} grid. In case of
+     *  num_ranks_xy = 1 this is the standard slab decomposition. */
+    FFT3D_base(std::array<int, 3> initial_dims__, Communicator const& comm__, device_t pu__, int num_ranks_xy__,
+               fftw_planner_t planner__ = fftw_planner())
+        : FFT3D_base(FFT3D_grid(initial_dims__), comm__, pu__, num_ranks_xy__, planner__)
+    {
+    }
+
+    /// Constructor of the FFT with the already chosen grid.
+    /** This is used with the grids of extended radices:
+     *  \code{.cpp}
+     *  FFT3D_grid grid(initial_dims, comm.size(), calibrate_fft_radix_cost<double>(comm));
+     *  FFT3D fft(grid, comm, device_t::CPU);
+     *  \endcode
+     */
+    FFT3D_base(FFT3D_grid const& grid__, Communicator const& comm__, device_t pu__, int num_ranks_xy__ = 1,
+               fftw_planner_t planner__ = fftw_planner())
+        : FFT3D_grid(grid__)
         , comm_(comm__)
         , pu_(pu__)
+        , num_ranks_xy_(num_ranks_xy__)
     {
         PROFILE("sddk::FFT3D::FFT3D");
 
+        if (num_ranks_xy_ < 1 || comm_.size() % num_ranks_xy_ != 0) {
+            std::stringstream s;
+            s << "wrong number of ranks in the xy-direction of the pencil decomposition" << std::endl
+              << "  number of ranks in the xy-direction : " << num_ranks_xy_ << std::endl
+              << "  size of the FFT communicator        : " << comm_.size();
+            TERMINATE(s);
+        }
+        if (num_ranks_xy_ > 1 && pu_ == device_t::GPU) {
+            TERMINATE("pencil decomposition is not implemented on GPU");
+        }
+        if (!std::is_same<T, double>::value && pu_ == device_t::GPU) {
+            TERMINATE("single precision FFT is not implemented on GPU");
+        }
+
+        a2a_compression_ = fft_a2a_compression();
+
+        auto cache_size = utils::get_env<int>("SDDK_FFT_LAYOUT_CACHE_SIZE");
+        if (cache_size != nullptr) {
+            layout_cache_size_ = std::max(0, *cache_size);
+        }
+
+        auto neighbor = utils::get_env<int>("SDDK_FFT_A2A_NEIGHBOR");
+        if (neighbor != nullptr) {
+            a2a_neighbor_ = (*neighbor != 0);
+        }
+
+        auto shm = utils::get_env<int>("SDDK_FFT_A2A_SHM");
+        if (shm != nullptr) {
+            a2a_shm_ = (*shm != 0);
+        }
+
+        auto nchunks = utils::get_env<int>("SDDK_FFT_A2A_CHUNKS");
+        if (nchunks != nullptr) {
+            num_a2a_chunks_ = std::max(1, *nchunks);
+        }
+
         /* split z-direction */
-        spl_z_        = splindex<block>(size(2), comm_.size(), comm_.rank());
+        spl_z_        = splindex<block>(size(2), comm_.size() / num_ranks_xy_, comm_.rank() / num_ranks_xy_);
         local_size_z_ = spl_z_.local_size();
         offset_z_     = spl_z_.global_offset();
 
+        /* split x- and y-directions in case of pencil decomposition */
+        spl_x_ = splindex<block>(size(0), num_ranks_xy_, comm_.rank() % num_ranks_xy_);
+        spl_y_ = splindex<block>(size(1), num_ranks_xy_, comm_.rank() % num_ranks_xy_);
+
+        if (num_ranks_xy_ > 1) {
+            mpi_grid_ = std::unique_ptr<MPI_grid>(new MPI_grid({comm_.size() / num_ranks_xy_, num_ranks_xy_}, comm_));
+        }
+
         if (pu_ == device_t::CPU) {
             host_memory_type_ = memory_t::host;
         } else {
             host_memory_type_ = memory_t::host_pinned;
         }
 
+        auto touch = utils::get_env<int>("SDDK_FFT_FIRST_TOUCH");
+        if (touch != nullptr) {
+            first_touch_ = (*touch != 0);
+        }
+
         /* allocate main buffer */
-        fft_buffer_ = mdarray<double_complex, 1>(local_size(), host_memory_type_, "FFT3D.fft_buffer_");
+        allocate_fft_buffer();
+
+        /* pad z-columns to 64 bytes */
+        zcol_stride_ = 4 * ((size(2) + 3) / 4);
+
+        /* keep a block of z-columns in L2 cache */
+        int l2_size = 256;
+        auto l2 = utils::get_env<int>("SDDK_FFT_L2_CACHE_SIZE");
+        if (l2 != nullptr) {
+            l2_size = std::max(1, *l2);
+        }
+        zcol_block_size_max_ =
+            std::max(1, static_cast<int>(l2_size * 1024 / (zcol_stride_ * sizeof(complex_t))));
 
         /* allocate 1d and 2d buffers */
+        fftw_buffer_z_        = std::vector<complex_t*>(omp_get_max_threads(), nullptr);
+        fftw_buffer_xy_       = std::vector<complex_t*>(omp_get_max_threads(), nullptr);
+        fftw_buffer_x_        = std::vector<complex_t*>(omp_get_max_threads(), nullptr);
+        fftw_buffer_xy_r_     = std::vector<T*>(omp_get_max_threads(), nullptr);
+        fftw_buffer_y_        = std::vector<complex_t*>(omp_get_max_threads(), nullptr);
+        fftw_buffer_z_pruned_ = std::vector<complex_t*>(omp_get_max_threads(), nullptr);
+        if (first_touch_) {
+            /* each thread allocates and touches its own buffers */
+            #pragma omp parallel
+            {
+                allocate_thread_buffers(omp_get_thread_num());
+            }
+        }
+        /* buffers of the threads which were not started */
         for (int i = 0; i < omp_get_max_threads(); i++) {
-            fftw_buffer_z_.push_back((double_complex*)fftw_malloc(size(2) * sizeof(double_complex)));
-            fftw_buffer_xy_.push_back((double_complex*)fftw_malloc(size(0) * size(1) * sizeof(double_complex)));
+            if (fftw_buffer_z_[i] == nullptr) {
+                allocate_thread_buffers(i);
+            }
         }
 
-        plan_forward_z_   = std::vector<fftw_plan>(omp_get_max_threads());
-        plan_forward_xy_  = std::vector<fftw_plan>(omp_get_max_threads());
-        plan_backward_z_  = std::vector<fftw_plan>(omp_get_max_threads());
-        plan_backward_xy_ = std::vector<fftw_plan>(omp_get_max_threads());
+        plan_forward_z_   = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_forward_xy_  = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_backward_z_  = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_backward_xy_ = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_forward_x_       = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_backward_x_      = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_forward_x_r2c_   = std::vector<fftw_plan_t>(omp_get_max_threads());
+        plan_backward_x_c2r_  = std::vector<fftw_plan_t>(omp_get_max_threads());
+
+        fftw_flags_ = fftw_planner_flag(planner__);
+        unsigned int flags = fftw_flags_;
+        if (planner__ != fftw_planner_t::estimate) {
+            fftw_wisdom_file_ = fftw_wisdom_file_name<T>({size(0), size(1), size(2)}, omp_get_max_threads());
+            load_fftw_wisdom<T>(fftw_wisdom_file_);
+        }
 
         for (int i = 0; i < omp_get_max_threads(); i++) {
-            plan_forward_z_[i] = fftw_plan_dft_1d(size(2), (fftw_complex*)fftw_buffer_z_[i],
-                                                  (fftw_complex*)fftw_buffer_z_[i], FFTW_FORWARD, FFTW_ESTIMATE);
+            plan_forward_z_[i] = fftw_t::plan_dft_1d(size(2), (fftw_complex_t*)fftw_buffer_z_[i],
+                                                     (fftw_complex_t*)fftw_buffer_z_[i], FFTW_FORWARD, flags);
+
+            plan_backward_z_[i] = fftw_t::plan_dft_1d(size(2), (fftw_complex_t*)fftw_buffer_z_[i],
+                                                      (fftw_complex_t*)fftw_buffer_z_[i], FFTW_BACKWARD, flags);
 
-            plan_backward_z_[i] = fftw_plan_dft_1d(size(2), (fftw_complex*)fftw_buffer_z_[i],
-                                                   (fftw_complex*)fftw_buffer_z_[i], FFTW_BACKWARD, FFTW_ESTIMATE);
+            plan_forward_xy_[i] = fftw_t::plan_dft_2d(size(1), size(0), (fftw_complex_t*)fftw_buffer_xy_[i],
+                                                      (fftw_complex_t*)fftw_buffer_xy_[i], FFTW_FORWARD, flags);
 
-            plan_forward_xy_[i] = fftw_plan_dft_2d(size(1), size(0), (fftw_complex*)fftw_buffer_xy_[i],
-                                                   (fftw_complex*)fftw_buffer_xy_[i], FFTW_FORWARD, FFTW_ESTIMATE);
+            plan_backward_xy_[i] = fftw_t::plan_dft_2d(size(1), size(0), (fftw_complex_t*)fftw_buffer_xy_[i],
+                                                       (fftw_complex_t*)fftw_buffer_xy_[i], FFTW_BACKWARD, flags);
 
-            plan_backward_xy_[i] = fftw_plan_dft_2d(size(1), size(0), (fftw_complex*)fftw_buffer_xy_[i],
-                                                    (fftw_complex*)fftw_buffer_xy_[i], FFTW_BACKWARD, FFTW_ESTIMATE);
+            plan_forward_x_[i] = fftw_t::plan_dft_1d(size(0), (fftw_complex_t*)fftw_buffer_x_[i],
+                                                     (fftw_complex_t*)fftw_buffer_x_[i], FFTW_FORWARD, flags);
+
+            plan_backward_x_[i] = fftw_t::plan_dft_1d(size(0), (fftw_complex_t*)fftw_buffer_x_[i],
+                                                      (fftw_complex_t*)fftw_buffer_x_[i], FFTW_BACKWARD, flags);
+
+            /* first half of the complex x-buffer is used to store the Hermitian-symmetric output of r2c transform */
+            plan_forward_x_r2c_[i] = fftw_t::plan_dft_r2c_1d(size(0), fftw_buffer_xy_r_[i],
+                                                             (fftw_complex_t*)fftw_buffer_x_[i], flags);
+
+            plan_backward_x_c2r_[i] = fftw_t::plan_dft_c2r_1d(size(0), (fftw_complex_t*)fftw_buffer_x_[i],
+                                                              fftw_buffer_xy_r_[i], flags);
+        }
+
+        /* sub-transforms of the pruned z-transforms */
+        auto pruning = utils::get_env<int>("SDDK_FFT_Z_PRUNING");
+        if (pruning != nullptr) {
+            z_pruning_ = (*pruning != 0);
+        }
+        for (int m = 1; 2 * m <= size(2); m++) {
+            if (size(2) % m == 0) {
+                z_prune_size_.push_back(m);
+            }
+        }
+        double const twopi = 6.2831853071795864769;
+        for (int j = 0; j < size(2); j++) {
+            double phase = twopi * j / size(2);
+            z_twiddle_.push_back(complex_t(std::cos(phase), std::sin(phase)));
         }
+        /* plans of the pruned sizes are created in prepare() when they are needed */
+        plan_forward_z_pruned_ = std::vector<std::vector<fftw_plan_t>>(
+            omp_get_max_threads(), std::vector<fftw_plan_t>(z_prune_size_.size(), nullptr));
+        plan_backward_z_pruned_ = plan_forward_z_pruned_;
+
+        /* 1D buffers and plans for the pencil decomposition and for the split xy-transforms */
+        for (int i = 0; i < omp_get_max_threads(); i++) {
+            plan_forward_y_.push_back(fftw_t::plan_dft_1d(size(1), (fftw_complex_t*)fftw_buffer_y_[i],
+                                                          (fftw_complex_t*)fftw_buffer_y_[i], FFTW_FORWARD, flags));
+            plan_backward_y_.push_back(fftw_t::plan_dft_1d(size(1), (fftw_complex_t*)fftw_buffer_y_[i],
+                                                           (fftw_complex_t*)fftw_buffer_y_[i], FFTW_BACKWARD,
+                                                           flags));
+        }
+        if (!fftw_wisdom_file_.empty()) {
+            store_fftw_wisdom<T>(fftw_wisdom_file_);
+        }
+
+        auto split = utils::get_env<int>("SDDK_FFT_XY_SPLIT_PLANES");
+        xy_split_planes_ = (split == nullptr) ? omp_get_max_threads() : std::max(0, *split);
 
 #if defined(__GPU)
         if (pu_ == device_t::GPU) {
@@ -795,19 +3725,43 @@ class FFT3D : public FFT3D_grid
     }
 
     /// Destructor.
-    ~FFT3D()
+    ~FFT3D_base()
     {
         if (gvec_partition_) {
             dismiss();
         }
+        for (auto& layout : layout_cache_) {
+            destroy_layout_plans(layout);
+        }
+        for (int i = 0; i < omp_get_max_threads(); i++) {
+            fftw_t::free(fftw_buffer_z_[i]);
+            fftw_t::free(fftw_buffer_xy_[i]);
+            fftw_t::free(fftw_buffer_x_[i]);
+            fftw_t::free(fftw_buffer_xy_r_[i]);
+
+            fftw_t::destroy_plan(plan_forward_z_[i]);
+            fftw_t::destroy_plan(plan_forward_xy_[i]);
+            fftw_t::destroy_plan(plan_backward_z_[i]);
+            fftw_t::destroy_plan(plan_backward_xy_[i]);
+            fftw_t::destroy_plan(plan_forward_x_[i]);
+            fftw_t::destroy_plan(plan_backward_x_[i]);
+            fftw_t::destroy_plan(plan_forward_x_r2c_[i]);
+            fftw_t::destroy_plan(plan_backward_x_c2r_[i]);
+        }
         for (int i = 0; i < omp_get_max_threads(); i++) {
-            fftw_free(fftw_buffer_z_[i]);
-            fftw_free(fftw_buffer_xy_[i]);
+            fftw_t::free(fftw_buffer_z_pruned_[i]);
+            for (size_t k = 0; k < z_prune_size_.size(); k++) {
+                if (plan_forward_z_pruned_[i][k]) {
+                    fftw_t::destroy_plan(plan_forward_z_pruned_[i][k]);
+                    fftw_t::destroy_plan(plan_backward_z_pruned_[i][k]);
+                }
+            }
+        }
+        for (size_t i = 0; i < fftw_buffer_y_.size(); i++) {
+            fftw_t::free(fftw_buffer_y_[i]);
 
-            fftw_destroy_plan(plan_forward_z_[i]);
-            fftw_destroy_plan(plan_forward_xy_[i]);
-            fftw_destroy_plan(plan_backward_z_[i]);
-            fftw_destroy_plan(plan_backward_xy_[i]);
+            fftw_t::destroy_plan(plan_forward_y_[i]);
+            fftw_t::destroy_plan(plan_backward_y_[i]);
         }
 #if defined(__GPU)
         if (pu_ == device_t::GPU) {
@@ -830,8 +3784,8 @@ class FFT3D : public FFT3D_grid
 
     /// Load real-space values to the FFT buffer.
     /** \param [in] data CPU pointer to the real-space data. */
-    template <typename T>
-    inline void input(T* data__)
+    template <typename U>
+    inline void input(U* data__)
     {
         for (int i = 0; i < local_size(); i++) {
             fft_buffer_[i] = data__[i];
@@ -842,8 +3796,9 @@ class FFT3D : public FFT3D_grid
     }
 
     /// Get real-space values from the FFT buffer.
-    /** \param [out] data CPU pointer to the real-space data. */
-    inline void output(double* data__)
+    /** \param [out] data CPU pointer to the real-space data of any real type. */
+    template <typename U>
+    inline void output(U* data__)
     {
         if (pu_ == device_t::GPU) {
             fft_buffer_.copy_to(memory_t::host);
@@ -855,11 +3810,11 @@ class FFT3D : public FFT3D_grid
 
     /// Get real-space values from the FFT buffer.
     /** \param [out] data CPU pointer to the real-space data. */
-    inline void output(double_complex* data__)
+    inline void output(complex_t* data__)
     {
         switch (pu_) {
             case CPU: {
-                std::memcpy(data__, fft_buffer_.at(memory_t::host), local_size() * sizeof(double_complex));
+                std::memcpy(data__, fft_buffer_.at(memory_t::host), local_size() * sizeof(complex_t));
                 break;
             }
             case GPU: {
@@ -869,10 +3824,44 @@ class FFT3D : public FFT3D_grid
         }
     }
 
+    /// Get complex real-space values of different precision from the FFT buffer.
+    /** \param [out] data CPU pointer to the real-space data. */
+    template <typename U>
+    inline void output(std::complex<U>* data__)
+    {
+        if (pu_ == device_t::GPU) {
+            fft_buffer_.copy_to(memory_t::host);
+        }
+        for (int i = 0; i < local_size(); i++) {
+            data__[i] = fft_buffer_[i];
+        }
+    }
+
+    /// Linear index inside the local part of FFT buffer by grid coordinates.
+    /** The y- and z-coordinates are counted from offset_y() and offset_z(). In the pencil decomposition the local
+     *  buffer is a {x, y, z} box of size(0), local_size_y() and local_size_z() elements, so the index of the base
+     *  class which assumes full xy-planes is hidden. */
+    inline int index_by_coord(int x__, int y__, int z__) const
+    {
+        return x__ + (y__ + z__ * local_size_y()) * size(0);
+    }
+
     /// Size of the local part of FFT buffer.
     inline int local_size() const
     {
-        return size(0) * size(1) * local_size_z();
+        return size(0) * local_size_y() * local_size_z();
+    }
+
+    /// Local size of y-dimension of FFT buffer; equal to size(1) in case of slab decomposition.
+    inline int local_size_y() const
+    {
+        return spl_y_.local_size();
+    }
+
+    /// Offset in the global y-dimension index.
+    inline int offset_y() const
+    {
+        return spl_y_.global_offset();
     }
 
     inline int local_size_z() const
@@ -886,33 +3875,132 @@ class FFT3D : public FFT3D_grid
     }
 
     /// Direct access to the FFT buffer
-    inline double_complex& buffer(int idx__)
+    inline complex_t& buffer(int idx__)
     {
         return fft_buffer_[idx__];
     }
 
     /// FFT buffer.
-    inline mdarray<double_complex, 1>& buffer()
+    inline mdarray<complex_t, 1>& buffer()
     {
         return fft_buffer_;
     }
 
+    /// FFT buffer for a batch of functions.
+    /** The buffer is reallocated if it can't store the requested number of functions. */
+    inline mdarray<complex_t, 2>& buffer_batch(int num_fft__)
+    {
+        if (static_cast<int>(fft_buffer_batch_.size(1)) < num_fft__) {
+            fft_buffer_batch_ = allocate_work_array<complex_t, 2>(host_memory_type_, "FFT3D.fft_buffer_batch_",
+                                                                  local_size(), num_fft__);
+            first_touch(fft_buffer_batch_.at(memory_t::host), fft_buffer_batch_.size());
+            if (pu_ == device_t::GPU) {
+                fft_buffer_batch_.allocate(memory_t::device);
+            }
+        }
+        return fft_buffer_batch_;
+    }
+
     /// Communicator of the FFT transform.
     Communicator const& comm() const
     {
         return comm_;
     }
 
-    /// True if this FFT transformation is parallel.
-    inline bool parallel() const
+    /// True if this FFT transformation is parallel.
+    inline bool parallel() const
+    {
+        return (comm_.size() != 1);
+    }
+
+    /// Return the type of processing unit.
+    inline device_t pu() const
+    {
+        return pu_;
+    }
+
+    /// Get compression of the all-to-all payload.
+    inline a2a_compression_t a2a_compression() const
+    {
+        return a2a_compression_;
+    }
+
+    /// Set compression of the all-to-all payload.
+    /** Compression is applied only to the exchanges in the host memory. The pipelined z-transformation
+     *  is not used with a compressed payload. */
+    inline void a2a_compression(a2a_compression_t a2a_compression__)
+    {
+        a2a_compression_ = a2a_compression__;
+    }
+
+    /// Check if the all-to-all exchange on the CPU swaps the buffers instead of copying them.
+    inline bool a2a_double_buffer() const
+    {
+        return a2a_double_buffer_;
+    }
+
+    /// Switch the double buffering of the all-to-all exchange on the CPU on or off.
+    /** Both modes give bit-identical results; the switch is provided for testing and benchmarking. */
+    inline void a2a_double_buffer(bool a2a_double_buffer__)
+    {
+        a2a_double_buffer_ = a2a_double_buffer__;
+    }
+
+    /// Switch the neighborhood collective for the exchange of z-sticks on or off.
+    /** The communication graph is built in prepare(), so the switch has to be set before. A cached layout of the
+     *  G-vector partition which was prepared with the other setting is discarded and created again. */
+    inline void a2a_neighbor(bool a2a_neighbor__)
+    {
+        a2a_neighbor_ = a2a_neighbor__;
+    }
+
+    /// Set the number of chunks of z-columns in the pipelined z-transformation.
+    /** The chunks are created in prepare(), so the number has to be set before. Use 1 to switch the pipelining
+     *  off. */
+    inline void a2a_chunks(int num_a2a_chunks__)
+    {
+        num_a2a_chunks_ = std::max(1, num_a2a_chunks__);
+    }
+
+    /// Switch the shared memory transport for the exchange of z-sticks inside the node on or off.
+    /** The auxiliary buffers are placed in the shared windows in prepare(), so the switch has to be set before. */
+    inline void a2a_shm(bool a2a_shm__)
+    {
+        a2a_shm_ = a2a_shm__;
+    }
+
+    /// Switch the pruned transformation of short z-columns on or off.
+    inline void z_pruning(bool z_pruning__)
+    {
+        z_pruning_ = z_pruning__;
+    }
+
+    /// Set the number of xy-planes below which each plane is transformed by all threads.
+    /** Use 0 to always distribute the planes between threads. */
+    inline void xy_split_planes(int xy_split_planes__)
     {
-        return (comm_.size() != 1);
+        xy_split_planes_ = std::max(0, xy_split_planes__);
     }
 
-    /// Return the type of processing unit.
-    inline device_t pu() const
+    /// Estimated error introduced by a single compressed all-to-all exchange.
+    /** This is the maximum error of an exchanged real or imaginary part relative to the largest absolute
+     *  value in the block of data sent to the same rank. */
+    inline double a2a_compression_error() const
     {
-        return pu_;
+        switch (a2a_compression_) {
+            case a2a_compression_t::single: {
+                return 0.5 * std::numeric_limits<float>::epsilon();
+            }
+            case a2a_compression_t::fixed16: {
+                return 0.5 / std::numeric_limits<int16_t>::max();
+            }
+            case a2a_compression_t::fixed8: {
+                return 0.5 / std::numeric_limits<int8_t>::max();
+            }
+            default: {
+                return 0;
+            }
+        }
     }
 
     // TODO: check if reallocation of FFT buffers can be omitted for better performance
@@ -925,6 +4013,8 @@ class FFT3D : public FFT3D_grid
      *    - address of G-vector partition object is saved in the internal class variable
      *    - positions of non-zero z-columns are stored in a buffer; this is actually a reason to make a preparatory 
      *      step: non-zero columns are different for different G-vector sets
+     *    - the layout of a partition which was already prepared and dismissed is taken from the LRU cache
+     *      instead of being recomputed
      *
      *  In case of GPU the following additional steps are performed:
      *    - a mapping between G-vector index an a position in FFT buffer for 1D z-transforms is created
@@ -944,41 +4034,9 @@ class FFT3D : public FFT3D_grid
         /* copy pointer to G-vector partition */
         gvec_partition_ = &gvp__;
 
-        /* create offses and counts for mpi a2a call; done for direction=1 (scattering of z-columns);
-           for direction=-1 send and recieve dimensions are interchanged */
-        a2a_send = block_data_descriptor(comm_.size());
-        a2a_recv = block_data_descriptor(comm_.size());
-        int rank = comm_.rank();
-        for (int r = 0; r < comm_.size(); r++) {
-            a2a_send.counts[r] = spl_z_.local_size(r) * gvec_partition_->zcol_count_fft(rank);
-            a2a_recv.counts[r] = spl_z_.local_size(rank) * gvec_partition_->zcol_count_fft(r);
-        }
-        a2a_send.calc_offsets();
-        a2a_recv.calc_offsets();
-
-        /* in case of reduced G-vector set we need to store a position of -x,-y column as well */
-        int nc = gvp__.gvec().reduced() ? 2 : 1;
-
-        utils::timer t1("sddk::FFT3D::prepare|cpu");
-        /* get positions of z-columns in xy plane */
-        z_col_pos_ = mdarray<int, 2>(gvp__.gvec().num_zcol(), nc, memory_t::host, "FFT3D.z_col_pos_");
-        #pragma omp parallel for schedule(static)
-        for (int i = 0; i < gvp__.gvec().num_zcol(); i++) {
-            int icol = gvp__.idx_zcol<index_domain_t::global>(i);
-            int x    = coord_by_freq<0>(gvp__.gvec().zcol(icol).x);
-            int y    = coord_by_freq<1>(gvp__.gvec().zcol(icol).y);
-            assert(x >= 0 && x < size(0));
-            assert(y >= 0 && y < size(1));
-            z_col_pos_(i, 0) = x + y * size(0);
-            if (gvp__.gvec().reduced()) {
-                x = coord_by_freq<0>(-gvp__.gvec().zcol(icol).x);
-                y = coord_by_freq<1>(-gvp__.gvec().zcol(icol).y);
-                assert(x >= 0 && x < size(0));
-                assert(y >= 0 && y < size(1));
-                z_col_pos_(i, 1) = x + y * size(0);
-            }
+        if (!restore_layout(gvp__)) {
+            prepare_layout(gvp__);
         }
-        t1.stop();
 
         /* init z-plan for G-vector transformation */
         if (gvp__.gvec().bare()) {
@@ -988,43 +4046,28 @@ class FFT3D : public FFT3D_grid
             zcol_gkvec_count_max_ = init_plan_z(gvp__, zcol_gkvec_count_max_, &acc_fft_plan_z_forward_gkvec_,
                                                 &acc_fft_plan_z_backward_gkvec_);
         }
-        reallocate_fft_buffer_aux(fft_buffer_aux1_);
-        reallocate_fft_buffer_aux(fft_buffer_aux2_);
+        if (mem_pool_) {
+            allocate_fft_buffer();
+            allocate_fft_buffer_aux_pool();
+        } else if (use_a2a_shm()) {
+            if (!fft_buffer_.size()) {
+                allocate_fft_buffer();
+            }
+            reallocate_fft_buffer_shm();
+        } else {
+            if (!fft_buffer_.size()) {
+                allocate_fft_buffer();
+            }
+            reallocate_fft_buffer_aux(fft_buffer_aux1_);
+            reallocate_fft_buffer_aux(fft_buffer_aux2_);
+            if (pu_ == device_t::CPU && comm_.size() > 1) {
+                reallocate_fft_buffer_aux(fft_buffer_a2a_);
+            }
+        }
 
         switch (pu_) {
             case device_t::GPU: {
                 utils::timer t2("sddk::FFT3D::prepare|gpu");
-                map_gvec_to_fft_buffer_ = mdarray<int, 1>(gvp__.gvec_count_fft(), memory_t::host,
-                                                          "FFT3D.map_gvec_to_fft_buffer_");
-                /* loop over local set of columns */
-                #pragma omp parallel for schedule(static)
-                for (int i = 0; i < gvp__.zcol_count_fft(); i++) {
-                    /* global index of z-column */
-                    int icol = gvec_partition_->idx_zcol<index_domain_t::local>(i);
-                    /* loop over z-colmn */
-                    for (size_t j = 0; j < gvp__.gvec().zcol(icol).z.size(); j++) {
-                        /* local index of the G-vector */
-                        size_t ig = gvp__.zcol_offs(icol) + j;
-                        /* coordinate inside FFT 1D bufer */
-                        int z = coord_by_freq<2>(gvp__.gvec().zcol(icol).z[j]);
-                        assert(z >= 0 && z < size(2));
-                        /* position of PW harmonic with index ig inside batched FFT buffer */
-                        map_gvec_to_fft_buffer_[ig] = i * size(2) + z;
-                    }
-                }
-                map_gvec_to_fft_buffer_.allocate(memory_t::device).copy_to(memory_t::device);
-
-                /* for the rank that stores {x=0,y=0} column we need to create a small second mapping */
-                if (gvp__.gvec().reduced() && comm_.rank() == 0) {
-                    map_gvec_to_fft_buffer_x0y0_ = mdarray<int, 1>(gvp__.gvec().zcol(0).z.size(), memory_t::host,
-                                                                   "FFT3D.map_gvec_to_fft_buffer_x0y0_");
-                    for (size_t j = 0; j < gvp__.gvec().zcol(0).z.size(); j++) {
-                        int z = coord_by_freq<2>(-gvp__.gvec().zcol(0).z[j]);
-                        assert(z >= 0 && z < size(2));
-                        map_gvec_to_fft_buffer_x0y0_[j] = z;
-                    }
-                    map_gvec_to_fft_buffer_x0y0_.allocate(memory_t::device).copy_to(memory_t::device);
-                }
 #if defined(__CUDA) || defined(__ROCM)
                 int zcol_count_max{0};
                 if (gvp__.gvec().bare()) {
@@ -1056,7 +4099,6 @@ class FFT3D : public FFT3D_grid
                 fft_buffer_aux1_.allocate(memory_t::device);
                 fft_buffer_aux2_.allocate(memory_t::device);
                 fft_buffer_.allocate(memory_t::device);
-                z_col_pos_.allocate(memory_t::device).copy_to(memory_t::device);
                 break;
             }
             case device_t::CPU: {
@@ -1065,18 +4107,42 @@ class FFT3D : public FFT3D_grid
         }
     }
 
+    /// Prepare FFT driver with the main and auxiliary buffers taken from a memory pool.
+    /** The buffers are allocated from the pool with the size required by this G-vector partition and are returned to
+     *  the pool in dismiss(). The work buffers of the batched, pipelined, asynchronous, compressed and pencil
+     *  transformations are also taken from the pool when they are first needed and are returned in dismiss(), so
+     *  that several FFT drivers which are not used at the same time can share one pool.
+     *  The values of buffer() are available only until dismiss(). The pool must outlive the FFT driver and must be
+     *  in the host memory; this mode works only on the CPU. */
+    void prepare(Gvec_partition const& gvp__, memory_pool& mp__)
+    {
+        if (pu_ != device_t::CPU || !is_host_memory(mp__.memory_type())) {
+            TERMINATE("memory pool of the host memory is required on the CPU");
+        }
+        mem_pool_ = &mp__;
+        prepare(gvp__);
+    }
+
+    /// Release the G-vector partition.
+    /** The layout of the partition is moved to the cache, so the next call to prepare() with the same partition
+     *  only restores it. The buffers taken from a memory pool are returned to the pool. */
     void dismiss()
     {
+        for (auto& s : async_) {
+            if (s.stage != async_stage_t::idle) {
+                TERMINATE("asynchronous transformation is not completed");
+            }
+        }
+
+        store_layout();
+
         switch (pu_) {
             case GPU: {
                 fft_buffer_aux1_.deallocate(memory_t::device);
                 fft_buffer_aux2_.deallocate(memory_t::device);
-                z_col_pos_.deallocate(memory_t::device);
                 fft_buffer_.deallocate(memory_t::device);
 #if defined(__GPU)
                 acc_fft_work_buf_.deallocate(memory_t::device);
-                map_gvec_to_fft_buffer_.deallocate(memory_t::device);
-                map_gvec_to_fft_buffer_x0y0_.deallocate(memory_t::device);
 #endif
                 break;
             }
@@ -1084,12 +4150,182 @@ class FFT3D : public FFT3D_grid
                 break;
             }
         }
+        if (mem_pool_) {
+            fft_buffer_             = mdarray<complex_t, 1>();
+            fft_buffer_aux1_        = mdarray<complex_t, 1>();
+            fft_buffer_aux2_        = mdarray<complex_t, 1>();
+            fft_buffer_a2a_         = mdarray<complex_t, 1>();
+            /* the work arrays only grow; after they are returned to the pool they are allocated again on demand */
+            fft_buffer_batch_       = mdarray<complex_t, 2>();
+            fft_buffer_aux_batch_   = mdarray<complex_t, 1>();
+            fft_buffer_a2a_batch_   = mdarray<complex_t, 1>();
+            fft_buffer_ring_        = mdarray<complex_t, 2>();
+            fft_buffer_async_       = mdarray<complex_t, 2>();
+            a2a_packed_send_        = mdarray<char, 1>();
+            a2a_packed_recv_        = mdarray<char, 1>();
+            fft_buffer_pencil_send_ = mdarray<complex_t, 1>();
+            fft_buffer_pencil_recv_ = mdarray<complex_t, 1>();
+            fft_buffer_pencil_y_    = mdarray<complex_t, 1>();
+            mem_pool_               = nullptr;
+        }
         gvec_partition_ = nullptr;
     }
 
+    /// Start the asynchronous transformation of a single function.
+    /** The transformation is split into the stages of the slab decomposition on the CPU: the z-transformation
+     *  (direction=1) or the xy-transformation (direction=-1) is done immediately and the exchange of z-sticks is
+     *  posted with a non-blocking all-to-all; the remaining stage is done when the request is completed.
+     *
+     *  The input of the forward transformation is taken from the FFT buffer at the call, so the buffer can be
+     *  refilled for the next transformation right away. The result of the backward transformation is stored in the
+     *  FFT buffer at the completion of the request. The PW coefficients must not be touched until then.
+     *
+     *  The exchange is a non-blocking all-to-all, or a neighborhood all-to-all if the graph of peers is created (see
+     *  a2a_neighbor()). The compressed exchange (see a2a_compression()) and the shared memory transport (see
+     *  a2a_shm()) can't be left in flight; with any of them, as in the pencil decomposition and on the GPU, the
+     *  backward transformation is deferred to the completion and the forward transformation is done
+     *  synchronously, both with the exchange of transform(). */
+    template <int direction>
+    async_request transform_async(complex_t* data__)
+    {
+        PROFILE("sddk::FFT3D::transform_async");
+
+        if (!gvec_partition_) {
+            TERMINATE("FFT3D is not ready");
+        }
+
+        int slot{-1};
+        for (int i = 0; i < static_cast<int>(async_.size()); i++) {
+            /* progress the exchanges in flight */
+            if (async_[i].stage == async_stage_t::exchange) {
+                int flag;
+                CALL_MPI(MPI_Test, (&async_[i].req, &flag, MPI_STATUS_IGNORE));
+            }
+            if (slot < 0 && async_[i].stage == async_stage_t::idle) {
+                slot = i;
+            }
+        }
+        if (slot < 0) {
+            TERMINATE("too many asynchronous transformations in flight");
+        }
+
+        auto& s     = async_[slot];
+        s.direction = direction;
+        s.data      = data__;
+
+        if (num_ranks_xy_ > 1 || pu_ == device_t::GPU || a2a_compression_ != a2a_compression_t::none ||
+            use_a2a_shm()) {
+            if (direction == 1) {
+                s.stage = async_stage_t::deferred;
+                return async_request(this, slot);
+            } else {
+                transform<direction>(data__);
+                return async_request();
+            }
+        }
+
+        size_t sz = fft_buffer_aux_size();
+        if (sz > fft_buffer_async_.size(0)) {
+            fft_buffer_async_ = allocate_work_array<complex_t, 2>(memory_t::host, "FFT3D.fft_buffer_async_", sz,
+                                                                  2 * async_.size());
+            first_touch(fft_buffer_async_.at(memory_t::host), fft_buffer_async_.size());
+        }
+        auto send = fft_buffer_async_.at(memory_t::host, 0, 2 * slot);
+        auto recv = fft_buffer_async_.at(memory_t::host, 0, 2 * slot + 1);
+
+        switch (direction) {
+            case 1: {
+                transform_z_serial_cpu<direction>(1, &data__, send);
+                break;
+            }
+            case -1: {
+                transform_xy_cpu<direction>(1, send, fft_buffer_.at(memory_t::host));
+                break;
+            }
+            default: {
+                TERMINATE("wrong direction");
+            }
+        }
+
+        s.stage = async_stage_t::exchange;
+        if (comm_.size() > 1) {
+            s.buf = recv;
+            if (a2a_graph_comm_.mpi_comm() != MPI_COMM_NULL) {
+                if (direction == 1) {
+                    compact_a2a_peer_counts(a2a_send.counts.data(), a2a_send.offsets.data(), a2a_recv.counts.data(),
+                                            a2a_recv.offsets.data(), s.peer_counts);
+                } else {
+                    compact_a2a_peer_counts(a2a_recv.counts.data(), a2a_recv.offsets.data(), a2a_send.counts.data(),
+                                            a2a_send.offsets.data(), s.peer_counts);
+                }
+                int n  = static_cast<int>(a2a_peers_.size());
+                auto c = s.peer_counts.data();
+                a2a_graph_comm_.ineighbor_alltoall(send, c, c + n, recv, c + 2 * n, c + 3 * n, &s.req);
+            } else if (direction == 1) {
+                comm_.ialltoall(send, a2a_send.counts.data(), a2a_send.offsets.data(), recv, a2a_recv.counts.data(),
+                                a2a_recv.offsets.data(), &s.req);
+            } else {
+                comm_.ialltoall(send, a2a_recv.counts.data(), a2a_recv.offsets.data(), recv, a2a_send.counts.data(),
+                                a2a_send.offsets.data(), &s.req);
+            }
+        } else {
+            s.buf = send;
+            s.req = MPI_REQUEST_NULL;
+        }
+
+        return async_request(this, slot);
+    }
+
+  protected:
+    /// Run the remaining stage of the asynchronous transformation once its exchange is completed.
+    void async_finish(int slot__)
+    {
+        auto& s = async_[slot__];
+
+        if (s.stage == async_stage_t::deferred) {
+            transform<1>(s.data);
+        } else {
+            if (s.direction == 1) {
+                transform_xy_cpu<1>(1, s.buf, fft_buffer_.at(memory_t::host));
+            } else {
+                transform_z_serial_cpu<-1>(1, &s.data, s.buf);
+            }
+        }
+        s = async_state_t();
+    }
+
+    /// Progress the asynchronous transformation and complete it if its exchange is done.
+    bool async_test(int slot__)
+    {
+        auto& s = async_[slot__];
+
+        if (s.stage == async_stage_t::exchange) {
+            int flag;
+            CALL_MPI(MPI_Test, (&s.req, &flag, MPI_STATUS_IGNORE));
+            if (!flag) {
+                return false;
+            }
+        }
+        async_finish(slot__);
+        return true;
+    }
+
+    /// Wait for the exchange of the asynchronous transformation and complete it.
+    void async_wait(int slot__)
+    {
+        auto& s = async_[slot__];
+
+        if (s.stage == async_stage_t::exchange) {
+            utils::timer t("sddk::FFT3D::transform_async|comm");
+            CALL_MPI(MPI_Wait, (&s.req, MPI_STATUS_IGNORE));
+        }
+        async_finish(slot__);
+    }
+
+  public:
     /// Transform a single functions.
     template <int direction, memory_t mem = memory_t::host>
-    void transform(double_complex* data__)
+    void transform(complex_t* data__)
     {
         PROFILE("sddk::FFT3D::transform");
 
@@ -1097,6 +4333,11 @@ class FFT3D : public FFT3D_grid
             TERMINATE("FFT3D is not ready");
         }
 
+        if (num_ranks_xy_ > 1) {
+            transform_pencil<direction>(data__);
+            return;
+        }
+
         switch (direction) {
             case 1: {
                 if (gvec_partition_->gvec().bare()) {
@@ -1124,7 +4365,7 @@ class FFT3D : public FFT3D_grid
 
     /// Transform two real functions.
     template <int direction, memory_t mem = memory_t::host>
-    void transform(double_complex* data1__, double_complex* data2__)
+    void transform(complex_t* data1__, complex_t* data2__)
     {
         PROFILE("sddk::FFT3D::transform");
 
@@ -1136,6 +4377,38 @@ class FFT3D : public FFT3D_grid
             TERMINATE("reduced set of G-vectors is required");
         }
 
+        /* in pencil decomposition the two real functions are transformed one by one */
+        if (num_ranks_xy_ > 1) {
+            auto buf = fft_buffer_.at(memory_t::host);
+            std::vector<complex_t> tmp(buf, buf + local_size());
+            switch (direction) {
+                case 1: {
+                    transform<direction>(data1__);
+                    std::copy(buf, buf + local_size(), tmp.begin());
+                    transform<direction>(data2__);
+                    for (int i = 0; i < local_size(); i++) {
+                        buf[i] = complex_t(tmp[i].real(), buf[i].real());
+                    }
+                    break;
+                }
+                case -1: {
+                    for (int i = 0; i < local_size(); i++) {
+                        buf[i] = tmp[i].real();
+                    }
+                    transform<direction>(data1__);
+                    for (int i = 0; i < local_size(); i++) {
+                        buf[i] = tmp[i].imag();
+                    }
+                    transform<direction>(data2__);
+                    break;
+                }
+                default: {
+                    TERMINATE("wrong direction");
+                }
+            }
+            return;
+        }
+
         switch (direction) {
             case 1: {
                 if (gvec_partition_->gvec().bare()) {
@@ -1164,8 +4437,334 @@ class FFT3D : public FFT3D_grid
             }
         }
     }
+
+    /// Apply a local operator to a function.
+    /** The function is transformed to real space, multiplied by V(r) and transformed back to the G-vector
+     *  coefficients data_out. On the CPU in the slab decomposition the multiplication is fused into the xy-step:
+     *  each xy-plane is multiplied while it stays in the per-thread buffers and the main FFT buffer is neither
+     *  written nor read. The real-space values are not available in buffer() afterwards in this case.
+     *
+     *  \param [in]  data_in  Input G-vector coefficients.
+     *  \param [in]  veff_r   Local real-space values of V(r) in the layout of the FFT buffer.
+     *  \param [out] data_out Output G-vector coefficients; can be the same pointer as data_in.
+     */
+    template <memory_t mem = memory_t::host>
+    void apply_local(complex_t* data_in__, T const* veff_r__, complex_t* data_out__)
+    {
+        PROFILE("sddk::FFT3D::apply_local");
+
+        if (!gvec_partition_) {
+            TERMINATE("FFT3D is not ready");
+        }
+
+        if (pu_ == device_t::GPU || num_ranks_xy_ > 1) {
+            transform<1, mem>(data_in__);
+            apply_local_r(veff_r__);
+            transform<-1, mem>(data_out__);
+            return;
+        }
+
+        void* plan_backward = gvec_partition_->gvec().bare() ? acc_fft_plan_z_backward_gvec_ :
+                                                               acc_fft_plan_z_backward_gkvec_;
+        void* plan_forward = gvec_partition_->gvec().bare() ? acc_fft_plan_z_forward_gvec_ :
+                                                              acc_fft_plan_z_forward_gkvec_;
+
+        transform_z<1>(data_in__, fft_buffer_aux1_, plan_backward, mem);
+        apply_local_xy_cpu(fft_buffer_aux1_.at(memory_t::host), veff_r__);
+        transform_z<-1>(data_out__, fft_buffer_aux1_, plan_forward, mem);
+    }
+
+    /// Apply a local operator to two real functions.
+    /** Same as above for two real functions given by the reduced set of G-vectors. */
+    template <memory_t mem = memory_t::host>
+    void apply_local(complex_t* data1_in__, complex_t* data2_in__, T const* veff_r__, complex_t* data1_out__,
+                     complex_t* data2_out__)
+    {
+        PROFILE("sddk::FFT3D::apply_local");
+
+        if (!gvec_partition_) {
+            TERMINATE("FFT3D is not ready");
+        }
+
+        if (!gvec_partition_->gvec().reduced()) {
+            TERMINATE("reduced set of G-vectors is required");
+        }
+
+        if (pu_ == device_t::GPU || num_ranks_xy_ > 1) {
+            transform<1, mem>(data1_in__, data2_in__);
+            apply_local_r(veff_r__);
+            transform<-1, mem>(data1_out__, data2_out__);
+            return;
+        }
+
+        void* plan_backward = gvec_partition_->gvec().bare() ? acc_fft_plan_z_backward_gvec_ :
+                                                               acc_fft_plan_z_backward_gkvec_;
+        void* plan_forward = gvec_partition_->gvec().bare() ? acc_fft_plan_z_forward_gvec_ :
+                                                              acc_fft_plan_z_forward_gkvec_;
+
+        transform_z<1>(data1_in__, fft_buffer_aux1_, plan_backward, mem);
+        transform_z<1>(data2_in__, fft_buffer_aux2_, plan_backward, mem);
+        apply_local_xy_cpu(fft_buffer_aux1_.at(memory_t::host), fft_buffer_aux2_.at(memory_t::host), veff_r__);
+        transform_z<-1>(data1_out__, fft_buffer_aux1_, plan_forward, mem);
+        transform_z<-1>(data2_out__, fft_buffer_aux2_, plan_forward, mem);
+    }
+
+    /// Apply a local operator to a set of functions.
+    /** On the CPU in the slab decomposition the functions are processed in a software pipeline: at each step the
+     *  backward z-transformation of the function i, the fused xy-step of the function i-1 and the forward
+     *  z-transformation of the function i-2 are done while the exchanges of z-sticks of the previous step are in
+     *  flight. The z-sticks of the functions in the pipeline are stored in a ring of auxiliary buffers. The
+     *  exchanges are non-blocking all-to-alls, or neighborhood all-to-alls if the graph of peers is created
+     *  (see a2a_neighbor()).
+     *
+     *  The compressed exchange (see a2a_compression()) and the shared memory transport (see a2a_shm()) can't
+     *  be overlapped with the computation; if any of them is in use, the functions are processed one by one with
+     *  the exchange of the single-function apply_local(), as they are on the GPU and in the pencil decomposition.
+     *
+     *  \param [in]  data_in  Pointers to the input G-vector coefficients of the functions.
+     *  \param [in]  veff_r   Local real-space values of V(r) in the layout of the FFT buffer.
+     *  \param [out] data_out Pointers to the output G-vector coefficients; can be the same as data_in.
+     */
+    template <memory_t mem = memory_t::host>
+    void apply_local(std::vector<complex_t*> const& data_in__, T const* veff_r__,
+                     std::vector<complex_t*> const& data_out__)
+    {
+        PROFILE("sddk::FFT3D::apply_local");
+
+        if (!gvec_partition_) {
+            TERMINATE("FFT3D is not ready");
+        }
+
+        int num_fft = static_cast<int>(data_in__.size());
+
+        if (static_cast<int>(data_out__.size()) != num_fft) {
+            TERMINATE("wrong number of output functions");
+        }
+
+        if (pu_ == device_t::GPU || num_ranks_xy_ > 1 || a2a_compression_ != a2a_compression_t::none ||
+            use_a2a_shm()) {
+            for (int i = 0; i < num_fft; i++) {
+                apply_local<mem>(data_in__[i], veff_r__, data_out__[i]);
+            }
+            return;
+        }
+
+        size_t sz = fft_buffer_aux_size();
+        if (sz > fft_buffer_ring_.size(0)) {
+            fft_buffer_ring_ = allocate_work_array<complex_t, 2>(memory_t::host, "FFT3D.fft_buffer_ring_", sz,
+                                                                 2 * pipeline_depth_);
+            first_touch(fft_buffer_ring_.at(memory_t::host), fft_buffer_ring_.size());
+        }
+
+        bool parallel = (comm_.size() > 1);
+
+        /* z-sticks packed for the exchange and z-sticks of the local slab for each slot of the ring */
+        auto zcols = [&](int i) { return fft_buffer_ring_.at(memory_t::host, 0, 2 * (i % pipeline_depth_)); };
+        auto slab  = [&](int i) {
+            return parallel ? fft_buffer_ring_.at(memory_t::host, 0, 2 * (i % pipeline_depth_) + 1) : zcols(i);
+        };
+
+        /* counts of the neighborhood exchange for the backward and forward transformation; they must stay
+           unchanged while the exchanges are in flight */
+        bool neighbor = (a2a_graph_comm_.mpi_comm() != MPI_COMM_NULL);
+        std::array<std::vector<int>, 2> peer_counts;
+        if (neighbor) {
+            compact_a2a_peer_counts(a2a_send.counts.data(), a2a_send.offsets.data(), a2a_recv.counts.data(),
+                                    a2a_recv.offsets.data(), peer_counts[0]);
+            compact_a2a_peer_counts(a2a_recv.counts.data(), a2a_recv.offsets.data(), a2a_send.counts.data(),
+                                    a2a_send.offsets.data(), peer_counts[1]);
+        }
+
+        std::array<MPI_Request, pipeline_depth_> req;
+        req.fill(MPI_REQUEST_NULL);
+
+        /* start the exchange of z-sticks of the function i; dir is 0 for the backward transformation and 1 for
+           the forward transformation */
+        auto exchange = [&](int i, int dir) {
+            auto send = (dir == 0) ? zcols(i) : slab(i);
+            auto recv = (dir == 0) ? slab(i) : zcols(i);
+            auto r    = &req[i % pipeline_depth_];
+            if (neighbor) {
+                int n  = static_cast<int>(a2a_peers_.size());
+                auto c = peer_counts[dir].data();
+                a2a_graph_comm_.ineighbor_alltoall(send, c, c + n, recv, c + 2 * n, c + 3 * n, r);
+            } else if (dir == 0) {
+                comm_.ialltoall(send, a2a_send.counts.data(), a2a_send.offsets.data(), recv, a2a_recv.counts.data(),
+                                a2a_recv.offsets.data(), r);
+            } else {
+                comm_.ialltoall(send, a2a_recv.counts.data(), a2a_recv.offsets.data(), recv, a2a_send.counts.data(),
+                                a2a_send.offsets.data(), r);
+            }
+        };
+
+        /* give MPI a chance to progress the exchanges in flight */
+        auto progress = [&]() {
+            int flag;
+            CALL_MPI(MPI_Testall, (pipeline_depth_, req.data(), &flag, MPI_STATUSES_IGNORE));
+        };
+
+        for (int step = 0; step < num_fft + 2; step++) {
+            /* backward z-transformation of the function i and the exchange of its z-sticks */
+            int i = step;
+            if (i < num_fft) {
+                transform_z_serial_cpu<1>(1, &data_in__[i], zcols(i));
+                if (parallel) {
+                    exchange(i, 0);
+                    progress();
+                }
+            }
+            /* fused xy-step of the function i-1 and the exchange of its z-sticks back */
+            i = step - 1;
+            if (i >= 0 && i < num_fft) {
+                if (parallel) {
+                    utils::timer t("sddk::FFT3D::apply_local|comm");
+                    CALL_MPI(MPI_Wait, (&req[i % pipeline_depth_], MPI_STATUS_IGNORE));
+                }
+                apply_local_xy_cpu(slab(i), veff_r__);
+                if (parallel) {
+                    exchange(i, 1);
+                    progress();
+                }
+            }
+            /* forward z-transformation of the function i-2 */
+            i = step - 2;
+            if (i >= 0) {
+                if (parallel) {
+                    utils::timer t("sddk::FFT3D::apply_local|comm");
+                    CALL_MPI(MPI_Wait, (&req[i % pipeline_depth_], MPI_STATUS_IGNORE));
+                }
+                transform_z_serial_cpu<-1>(1, &data_out__[i], zcols(i));
+            }
+        }
+    }
+
+    /// Accumulate the density of a set of functions.
+    /** The weighted squared magnitudes of the real-space values of all functions are added to rho_r:
+     *  \f[
+     *    \rho({\bf r}) \mathrel{+}= \sum_i w_i |\psi_i({\bf r})|^2
+     *  \f]
+     *  On the CPU in the slab decomposition the z-columns of all functions are transformed as a batch and the
+     *  density is accumulated directly from the per-thread xy-buffers; the real-space values of the functions are
+     *  never stored in the FFT buffer. Otherwise the functions are transformed one by one.
+     *
+     *  \param [in]    data    Pointers to the G-vector coefficients of the functions.
+     *  \param [in]    weights Weights of the functions.
+     *  \param [inout] rho_r   Local real-space values of the density in the layout of the FFT buffer.
+     */
+    template <memory_t mem = memory_t::host>
+    void accumulate_density(std::vector<complex_t*> const& data__, std::vector<T> const& weights__, T* rho_r__)
+    {
+        PROFILE("sddk::FFT3D::accumulate_density");
+
+        if (!gvec_partition_) {
+            TERMINATE("FFT3D is not ready");
+        }
+
+        int num_fft = static_cast<int>(data__.size());
+
+        if (static_cast<int>(weights__.size()) != num_fft) {
+            TERMINATE("wrong number of weights");
+        }
+
+        if (pu_ == device_t::GPU || num_ranks_xy_ > 1) {
+            for (int i = 0; i < num_fft; i++) {
+                transform<1, mem>(data__[i]);
+                if (pu_ == device_t::GPU) {
+                    fft_buffer_.copy_to(memory_t::host);
+                }
+                #pragma omp parallel for schedule(static)
+                for (int ir = 0; ir < local_size(); ir++) {
+                    rho_r__[ir] += weights__[i] * std::norm(fft_buffer_[ir]);
+                }
+            }
+            return;
+        }
+
+        reallocate_fft_buffer_aux_batch(num_fft);
+
+        transform_z_batch<1>(data__);
+        accumulate_density_xy_cpu(num_fft, fft_buffer_aux_batch_.at(memory_t::host), weights__.data(), rho_r__);
+    }
+
+    /// Transform a batch of functions with the same G-vector partition.
+    /** The z-transforms of all functions are done first, then the z-sticks of all functions are exchanged in a single
+     *  all-to-all call and finally the xy-planes of all functions are transformed. The real-space values of the
+     *  function i are stored in the column i of buffer_batch().
+     *
+     *  On the GPU and in the pencil decomposition the functions are transformed one by one.
+     */
+    template <int direction, memory_t mem = memory_t::host>
+    void transform_batch(std::vector<complex_t*> const& data__)
+    {
+        PROFILE("sddk::FFT3D::transform_batch");
+
+        if (!gvec_partition_) {
+            TERMINATE("FFT3D is not ready");
+        }
+
+        int num_fft = static_cast<int>(data__.size());
+
+        buffer_batch(num_fft);
+
+        if (num_ranks_xy_ > 1) {
+            for (int i = 0; i < num_fft; i++) {
+                auto ptr = fft_buffer_batch_.at(memory_t::host, 0, i);
+                if (direction == -1) {
+                    std::copy(ptr, ptr + local_size(), fft_buffer_.at(memory_t::host));
+                }
+                transform<direction>(data__[i]);
+                if (direction == 1) {
+                    std::copy(fft_buffer_.at(memory_t::host), fft_buffer_.at(memory_t::host) + local_size(), ptr);
+                }
+            }
+            return;
+        }
+
+        if (pu_ == device_t::GPU) {
+#if defined(__GPU)
+            for (int i = 0; i < num_fft; i++) {
+                if (direction == -1) {
+                    acc::copy(fft_buffer_.at(memory_t::device), fft_buffer_batch_.at(memory_t::device, 0, i),
+                              local_size());
+                }
+                transform<direction, mem>(data__[i]);
+                if (direction == 1) {
+                    acc::copy(fft_buffer_batch_.at(memory_t::device, 0, i), fft_buffer_.at(memory_t::device),
+                              local_size());
+                }
+            }
+#endif
+            return;
+        }
+
+        reallocate_fft_buffer_aux_batch(num_fft);
+
+        switch (direction) {
+            case 1: {
+                transform_z_batch<direction>(data__);
+                transform_xy_cpu<direction>(num_fft, fft_buffer_aux_batch_.at(memory_t::host),
+                                            fft_buffer_batch_.at(memory_t::host));
+                break;
+            }
+            case -1: {
+                transform_xy_cpu<direction>(num_fft, fft_buffer_aux_batch_.at(memory_t::host),
+                                            fft_buffer_batch_.at(memory_t::host));
+                transform_z_batch<direction>(data__);
+                break;
+            }
+            default: {
+                TERMINATE("wrong direction");
+            }
+        }
+    }
 };
 
+/// Double precision FFT driver.
+typedef FFT3D_base<double> FFT3D;
+
+/// Single precision FFT driver.
+typedef FFT3D_base<float> FFT3D_float;
+
 } // namespace sddk
 
 #endif // __FFT3D_H__
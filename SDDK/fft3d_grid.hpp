@@ -27,6 +27,19 @@
 
 namespace sddk {
 
+/// Relative cost of the FFT passes of different radices.
+/** The weight of a radix is the time of a single pass of this radix per element of the transform; weights are
+ *  normalized to the radix 2. The default values are rough estimates; calibrate_fft_radix_cost() replaces them
+ *  by the measured ones. */
+struct fft_radix_cost
+{
+    /// Allowed prime factors of the grid size.
+    std::array<int, 5> radix{{2, 3, 5, 7, 11}};
+
+    /// Cost of a pass of each radix.
+    std::array<double, 5> weight{{1.0, 1.3, 1.6, 2.1, 3.2}};
+};
+
 /// Handling of FFT grids.
 class FFT3D_grid
 {
@@ -55,12 +68,88 @@ class FFT3D_grid
         }
     }
 
+    /// Cost of a 1D transformation of size n per element.
+    /** \return Negative value if n has a prime factor which is not in the list of radices. */
+    static double grid_size_cost(int n__, fft_radix_cost const& cost__)
+    {
+        double c{0};
+        for (int i = 0; i < static_cast<int>(cost__.radix.size()); i++) {
+            while (n__ % cost__.radix[i] == 0) {
+                n__ /= cost__.radix[i];
+                c += cost__.weight[i];
+            }
+        }
+        return (n__ == 1) ? c : -1;
+    }
+
+    /// Candidate sizes of a dimension starting from n.
+    /** Sizes with the allowed prime factors not larger than 5/4 of n are taken; the number of candidates is
+     *  limited to keep the search over all three dimensions short. */
+    static std::vector<int> grid_size_candidates(int n__, fft_radix_cost const& cost__)
+    {
+        int const max_candidates{8};
+
+        std::vector<int> result;
+        for (int m = n__; static_cast<int>(result.size()) < max_candidates; m++) {
+            if (m > n__ + n__ / 4 && result.size()) {
+                break;
+            }
+            if (grid_size_cost(m, cost__) >= 0) {
+                result.push_back(m);
+            }
+        }
+        return result;
+    }
+
+    /// Find grid sizes with the smallest cost of the parallel transformation.
+    /** The cost model of the slab decomposition is
+     *  \f[
+     *    N_x N_y \lceil N_z / P \rceil P (c(N_x) + c(N_y)) + N_x N_y N_z c(N_z)
+     *  \f]
+     *  where c(n) is the per-element cost of the 1D transformation and P is the number of ranks along z. The first
+     *  term is the time of the xy-transformations of the largest slab, so sizes of z which are not divisible by
+     *  the number of ranks are penalized. */
+    void find_grid_size(std::array<int, 3> initial_dims__, int num_ranks_z__, fft_radix_cost const& cost__)
+    {
+        std::array<std::vector<int>, 3> candidates;
+        for (int i = 0; i < 3; i++) {
+            candidates[i] = grid_size_candidates(initial_dims__[i], cost__);
+        }
+
+        double best_cost{-1};
+        for (int n0 : candidates[0]) {
+            for (int n1 : candidates[1]) {
+                for (int n2 : candidates[2]) {
+                    /* local size of the largest slab */
+                    int nz_loc = (n2 + num_ranks_z__ - 1) / num_ranks_z__;
+
+                    double c = static_cast<double>(n0) * n1 * nz_loc * num_ranks_z__ *
+                                   (grid_size_cost(n0, cost__) + grid_size_cost(n1, cost__)) +
+                               static_cast<double>(n0) * n1 * n2 * grid_size_cost(n2, cost__);
+
+                    if (best_cost < 0 || c < best_cost) {
+                        best_cost = c;
+                        grid_size_ = {n0, n1, n2};
+                    }
+                }
+            }
+        }
+        set_grid_limits();
+    }
+
     /// Find grid sizes and limits for all three dimensions.
     void find_grid_size(std::array<int, 3> initial_dims__)
     {
         for (int i = 0; i < 3; i++) {
             grid_size_[i] = find_grid_size(initial_dims__[i]);
+        }
+        set_grid_limits();
+    }
 
+    /// Set limits of the frequencies and check the mapping between frequencies and coordinates.
+    void set_grid_limits()
+    {
+        for (int i = 0; i < 3; i++) {
             grid_limits_[i].second = grid_size_[i] / 2;
             grid_limits_[i].first  = grid_limits_[i].second - grid_size_[i] + 1;
         }
@@ -90,6 +179,14 @@ class FFT3D_grid
         find_grid_size(initial_dims__);
     }
 
+    /// Create FFT grid with extended set of radices.
+    /** Sizes of the dimensions are chosen with the cost model among the sizes with prime factors from the given
+     *  list of radices; the divisibility of the z-dimension by the number of ranks is taken into account. */
+    FFT3D_grid(std::array<int, 3> initial_dims__, int num_ranks_z__, fft_radix_cost const& cost__ = fft_radix_cost())
+    {
+        find_grid_size(initial_dims__, num_ranks_z__, cost__);
+    }
+
     /// Limits of a given dimension.
     inline const std::pair<int, int>& limits(int idim__) const
     {
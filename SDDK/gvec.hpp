@@ -837,6 +837,12 @@ class Gvec
         return z_columns_[idx__];
     }
 
+    /// Set of G-vectors on which the current distribution is based; nullptr if there is no base set.
+    inline Gvec const* gvec_base() const
+    {
+        return gvec_base_;
+    }
+
     inline int gvec_base_mapping(int igloc_base__) const
     {
         assert(gvec_base_ != nullptr);
@@ -991,6 +997,16 @@ class Gvec_partition
     /// Global index of G-vector by local index inside fat-salb.
     mdarray<int, 1> idx_gvec_;
 
+    /// Unique identifier of this partition.
+    size_t id_;
+
+    /// Get the next unique identifier.
+    static size_t next_id()
+    {
+        static size_t id{0};
+        return id++;
+    }
+
     inline void build_fft_distr()
     {
         /* calculate distribution of G-vectors and z-columns for the FFT communicator */
@@ -1058,6 +1074,7 @@ class Gvec_partition
         : gvec_(gvec__)
         , fft_comm_(fft_comm__)
         , comm_ortho_fft_(comm_ortho_fft__)
+        , id_(next_id())
     {
         if (fft_comm_.size() * comm_ortho_fft_.size() != gvec_.comm().size()) {
             std::stringstream s;
@@ -1169,6 +1186,14 @@ class Gvec_partition
         return gvec_;
     }
 
+    /// Unique identifier of the partition.
+    /** Identifiers are never reused, even if the partition is destroyed and another one is created at the same
+     *  address. */
+    inline size_t id() const
+    {
+        return id_;
+    }
+
     void gather_pw_fft(std::complex<double>* f_pw_local__, std::complex<double>* f_pw_fft__) const
     {
         int rank = gvec().comm().rank();
@@ -1188,6 +1213,85 @@ class Gvec_partition
     }
 };
 
+/// Fourier interpolation between a coarse and a fine G-vector set in the FFT-friendly distribution.
+/** The fine set must be created on top of the coarse set (see Gvec(double Gmax__, Gvec const& gvec_base__)), so
+ *  that each rank stores the fine counterparts of its coarse G-vectors, and both partitions must use the same FFT
+ *  and orthogonal communicators. The local mapping between the sets is gathered once over the orthogonal
+ *  communicator in the same way as the PW coefficients in Gvec_partition::gather_pw_fft(); after that the
+ *  prolongation (coarse to fine) and the restriction (fine to coarse) are local copies of the PW coefficients.
+ *
+ *  Coefficients of the FFT driver don't depend on the size of the grid, so the prolongation is the exact Fourier
+ *  interpolation of a function to the fine grid and the restriction drops the components beyond the coarse
+ *  cutoff; no 3D transformation is needed in either direction. */
+class Gvec_interpolation
+{
+  private:
+    /// Partition of the coarse G-vector set.
+    Gvec_partition const& coarse_;
+
+    /// Partition of the fine G-vector set.
+    Gvec_partition const& fine_;
+
+    /// Position of each local coarse G-vector of the FFT distribution in the local fine G-vectors.
+    mdarray<int, 1> map_;
+
+  public:
+    Gvec_interpolation(Gvec_partition const& coarse__, Gvec_partition const& fine__)
+        : coarse_(coarse__)
+        , fine_(fine__)
+    {
+        PROFILE("sddk::Gvec_interpolation");
+
+        if (fine_.gvec().gvec_base() != &coarse_.gvec()) {
+            TERMINATE("fine G-vector set is not based on the coarse set");
+        }
+        if (fine_.fft_comm().size() != coarse_.fft_comm().size() ||
+            fine_.comm_ortho_fft().size() != coarse_.comm_ortho_fft().size()) {
+            TERMINATE("coarse and fine partitions have different communicators");
+        }
+
+        /* local mapping of this rank */
+        int n = coarse_.gvec().count();
+        std::vector<int> m(n);
+        for (int ig = 0; ig < n; ig++) {
+            m[ig] = fine_.gvec().gvec_base_mapping(ig);
+        }
+
+        /* collect the mappings of the fat slab */
+        map_ = mdarray<int, 1>(coarse_.gvec_count_fft());
+        coarse_.comm_ortho_fft().allgather(m.data(), n, map_.at(memory_t::host), coarse_.gvec_fft_slab().counts.data(),
+                                           coarse_.gvec_fft_slab().offsets.data());
+        /* shift the local fine indices by the position of their block in the fine slab */
+        for (int i = 0; i < coarse_.comm_ortho_fft().size(); i++) {
+            for (int ig = 0; ig < coarse_.gvec_fft_slab().counts[i]; ig++) {
+                map_[coarse_.gvec_fft_slab().offsets[i] + ig] += fine_.gvec_fft_slab().offsets[i];
+            }
+        }
+    }
+
+    /// Prolongate the PW coefficients of a function from the coarse to the fine G-vector set.
+    /** Coefficients of the fine G-vectors beyond the coarse set are set to zero. */
+    template <typename T>
+    void coarse_to_fine(std::complex<T> const* f_coarse__, std::complex<T>* f_fine__) const
+    {
+        std::fill(f_fine__, f_fine__ + fine_.gvec_count_fft(), std::complex<T>(0, 0));
+        #pragma omp parallel for schedule(static)
+        for (int ig = 0; ig < coarse_.gvec_count_fft(); ig++) {
+            f_fine__[map_[ig]] = f_coarse__[ig];
+        }
+    }
+
+    /// Restrict the PW coefficients of a function from the fine to the coarse G-vector set.
+    template <typename T>
+    void fine_to_coarse(std::complex<T> const* f_fine__, std::complex<T>* f_coarse__) const
+    {
+        #pragma omp parallel for schedule(static)
+        for (int ig = 0; ig < coarse_.gvec_count_fft(); ig++) {
+            f_coarse__[ig] = f_fine__[map_[ig]];
+        }
+    }
+};
+
 /// Helper class to redistribute G-vectors for symmetrization.
 /** G-vectors are remapped from default distribution which balances both the local number
  *  of z-columns and G-vectors to the distributio of G-vector shells in which each MPI rank stores
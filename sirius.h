@@ -125,8 +125,10 @@ inline void finalize(bool call_mpi_fin__ = true, bool reset_device__ = true, boo
             acc::reset();
         }
     }
+    sddk::save_fftw_wisdom();
     if (fftw_cleanup__) {
         fftw_cleanup();
+        fftwf_cleanup();
     }
 
     utils::stop_global_timer();
@@ -43,9 +43,1001 @@ int test_fft_complex(cmd_args& args, device_t fft_pu__)
     }
 }
 
+int test_fft_batch(cmd_args& args, device_t fft_pu__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), false);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    int const num_fft{4};
+
+    mdarray<double_complex, 2> f(gvp.gvec_count_fft(), num_fft);
+    mdarray<double_complex, 2> g(gvp.gvec_count_fft(), num_fft);
+    std::vector<double_complex*> fptr(num_fft);
+    std::vector<double_complex*> gptr(num_fft);
+    for (int i = 0; i < num_fft; i++) {
+        for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+            f(ig, i) = utils::random<double_complex>();
+        }
+        fptr[i] = f.at(memory_t::host, 0, i);
+        gptr[i] = g.at(memory_t::host, 0, i);
+    }
+
+    fft.transform_batch<1>(fptr);
+    fft.transform_batch<-1>(gptr);
+
+    double diff{0};
+    for (int i = 0; i < num_fft; i++) {
+        for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+            diff += std::pow(std::abs(f(ig, i) - g(ig, i)), 2);
+        }
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec.num_gvec() / num_fft);
+
+    fft.dismiss();
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_real(cmd_args& args, device_t fft_pu__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), true);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    mdarray<double_complex, 1> f(gvp.gvec_count_fft());
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    /* G=0 component of a real function is real */
+    if (Communicator::world().rank() == 0) {
+        f[0] = f[0].real();
+    }
+    mdarray<double_complex, 1> g(gvp.gvec_count_fft());
+
+    fft.transform<1>(f.at(memory_t::host));
+    fft.transform<-1>(g.at(memory_t::host));
+
+    double diff{0};
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        diff += std::pow(std::abs(f[ig] - g[ig]), 2);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec.num_gvec());
+
+    fft.dismiss();
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_pencil(cmd_args& args, device_t fft_pu__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    /* two ranks in the xy-direction if possible, otherwise all ranks */
+    int num_ranks_xy = (Communicator::world().size() % 2 == 0) ? 2 : Communicator::world().size();
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__, num_ranks_xy);
+
+    Gvec gvec(M, cutoff, Communicator::world(), false);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    mdarray<double_complex, 1> f(gvp.gvec_count_fft());
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    mdarray<double_complex, 1> g(gvp.gvec_count_fft());
+
+    fft.transform<1>(f.at(memory_t::host));
+    fft.transform<-1>(g.at(memory_t::host));
+
+    double diff{0};
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        diff += std::pow(std::abs(f[ig] - g[ig]), 2);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec.num_gvec());
+
+    /* single harmonics must give the plane waves exp(iGr) in the local {x, y, z} box */
+    double const twopi = 6.28318530717958647692528676656;
+    for (int ig : {0, 1, gvec.num_gvec() / 2, gvec.num_gvec() - 1}) {
+        auto v = gvec.gvec(ig);
+        for (int igloc = 0; igloc < gvp.gvec_count_fft(); igloc++) {
+            f[igloc] = (gvp.idx_gvec(igloc) == ig) ? 1.0 : 0.0;
+        }
+        fft.transform<1>(f.at(memory_t::host));
+
+        double d{0};
+        for (int j0 = 0; j0 < fft.size(0); j0++) {
+            for (int j1 = 0; j1 < fft.local_size_y(); j1++) {
+                for (int j2 = 0; j2 < fft.local_size_z(); j2++) {
+                    auto rl = vector3d<double>(double(j0) / fft.size(0), double(fft.offset_y() + j1) / fft.size(1),
+                                               double(fft.offset_z() + j2) / fft.size(2));
+                    int idx = fft.index_by_coord(j0, j1, j2);
+                    d += std::pow(std::abs(fft.buffer(idx) - std::exp(double_complex(0.0, twopi * dot(rl, v)))), 2);
+                }
+            }
+        }
+        Communicator::world().allreduce(&d, 1);
+        diff += std::sqrt(d / fft.size());
+    }
+
+    fft.dismiss();
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_float(cmd_args& args, device_t fft_pu__, bool reduce__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D_float fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    mdarray<std::complex<float>, 1> f(gvp.gvec_count_fft());
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    /* G=0 component of a real function is real */
+    if (reduce__ && Communicator::world().rank() == 0) {
+        f[0] = f[0].real();
+    }
+    mdarray<std::complex<float>, 1> g(gvp.gvec_count_fft());
+
+    fft.transform<1>(f.at(memory_t::host));
+    fft.transform<-1>(g.at(memory_t::host));
+
+    double diff{0};
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        diff += std::pow(std::abs(f[ig] - g[ig]), 2);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec.num_gvec());
+
+    fft.dismiss();
+
+    if (diff > 1e-5) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_compression(cmd_args& args, device_t fft_pu__, a2a_compression_t compression__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    fft.a2a_compression(compression__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), false);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    mdarray<double_complex, 1> f(gvp.gvec_count_fft());
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    mdarray<double_complex, 1> g(gvp.gvec_count_fft());
+
+    fft.transform<1>(f.at(memory_t::host));
+    fft.transform<-1>(g.at(memory_t::host));
+
+    double diff{0};
+    double norm{0};
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        diff += std::pow(std::abs(f[ig] - g[ig]), 2);
+        norm += std::pow(std::abs(f[ig]), 2);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    Communicator::world().allreduce(&norm, 1);
+    diff = std::sqrt(diff / norm);
+
+    fft.dismiss();
+
+    /* the error of each of the two exchanges is bound relative to the largest value in a block */
+    double tol = (Communicator::world().size() == 1) ? 1e-10 : 4 * fft.a2a_compression_error() + 1e-10;
+    if (diff > tol) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_layout_cache(cmd_args& args, device_t fft_pu__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    /* two different G+k sets; layouts are restored from the cache when the sets are visited again */
+    Gvec gvec1({0, 0, 0}, M, cutoff, Communicator::world(), false);
+    Gvec gvec2({0.25, 0.1, 0}, M, cutoff, Communicator::world(), false);
+
+    Gvec_partition gvp1(gvec1, fft.comm(), Communicator::self());
+    Gvec_partition gvp2(gvec2, fft.comm(), Communicator::self());
+
+    double diff{0};
+    for (int i = 0; i < 4; i++) {
+        auto& gvp = (i % 2) ? gvp2 : gvp1;
+
+        fft.prepare(gvp);
+
+        mdarray<double_complex, 1> f(gvp.gvec_count_fft());
+        for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+            f[ig] = utils::random<double_complex>();
+        }
+        mdarray<double_complex, 1> g(gvp.gvec_count_fft());
+
+        fft.transform<1>(f.at(memory_t::host));
+        fft.transform<-1>(g.at(memory_t::host));
+
+        for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+            diff += std::pow(std::abs(f[ig] - g[ig]), 2);
+        }
+
+        fft.dismiss();
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec1.num_gvec());
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_apply_local(cmd_args& args, device_t fft_pu__, bool reduce__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    int ngv = gvp.gvec_count_fft();
+
+    std::vector<double> veff(fft.local_size());
+    for (auto& v : veff) {
+        v = utils::random<double>();
+    }
+
+    mdarray<double_complex, 2> f(ngv, 2);
+    for (int i = 0; i < 2; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            f(ig, i) = utils::random<double_complex>();
+        }
+        /* G=0 component of a real function is real */
+        if (reduce__ && Communicator::world().rank() == 0) {
+            f(0, i) = f(0, i).real();
+        }
+    }
+
+    /* reference: transform, multiply and transform back */
+    mdarray<double_complex, 2> g_ref(ngv, 2);
+    for (int i = 0; i < 2; i++) {
+        fft.transform<1>(&f(0, i));
+        for (int ir = 0; ir < fft.local_size(); ir++) {
+            fft.buffer(ir) *= veff[ir];
+        }
+        fft.transform<-1>(&g_ref(0, i));
+    }
+
+    mdarray<double_complex, 2> g(ngv, 2);
+    if (reduce__) {
+        fft.apply_local(&f(0, 0), &f(0, 1), veff.data(), &g(0, 0), &g(0, 1));
+    } else {
+        for (int i = 0; i < 2; i++) {
+            fft.apply_local(&f(0, i), veff.data(), &g(0, i));
+        }
+    }
+
+    double diff{0};
+    for (int i = 0; i < 2; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            diff += std::pow(std::abs(g(ig, i) - g_ref(ig, i)), 2);
+        }
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec.num_gvec());
+
+    fft.dismiss();
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_apply_local_pipeline(cmd_args& args, device_t fft_pu__, bool reduce__, bool a2a_neighbor__,
+                                  bool a2a_shm__, a2a_compression_t a2a_compression__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+    fft.a2a_neighbor(a2a_neighbor__);
+    fft.a2a_shm(a2a_shm__);
+    fft.a2a_compression(a2a_compression__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    int ngv = gvp.gvec_count_fft();
+
+    std::vector<double> veff(fft.local_size());
+    for (auto& v : veff) {
+        v = utils::random<double>();
+    }
+
+    /* more functions than the depth of the pipeline */
+    int num_fft{5};
+
+    mdarray<double_complex, 2> f(ngv, num_fft);
+    for (int i = 0; i < num_fft; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            f(ig, i) = utils::random<double_complex>();
+        }
+        if (reduce__ && Communicator::world().rank() == 0) {
+            f(0, i) = f(0, i).real();
+        }
+    }
+
+    /* reference: functions one by one; the pipeline must use the same exchange, so the results are identical
+       also with the lossy compression of the payload */
+    mdarray<double_complex, 2> g_ref(ngv, num_fft);
+    for (int i = 0; i < num_fft; i++) {
+        fft.apply_local(&f(0, i), veff.data(), &g_ref(0, i));
+    }
+
+    mdarray<double_complex, 2> g(ngv, num_fft);
+    std::vector<double_complex*> in;
+    std::vector<double_complex*> out;
+    for (int i = 0; i < num_fft; i++) {
+        in.push_back(&f(0, i));
+        out.push_back(&g(0, i));
+    }
+    fft.apply_local(in, veff.data(), out);
+
+    int diff{0};
+    for (int i = 0; i < num_fft; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            if (g(ig, i) != g_ref(ig, i)) {
+                diff++;
+            }
+        }
+    }
+    Communicator::world().allreduce(&diff, 1);
+
+    fft.dismiss();
+
+    if (diff) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_density(cmd_args& args, device_t fft_pu__, bool reduce__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    int ngv = gvp.gvec_count_fft();
+
+    int num_bands = 5;
+
+    mdarray<double_complex, 2> f(ngv, num_bands);
+    std::vector<double_complex*> data;
+    std::vector<double> weights;
+    for (int i = 0; i < num_bands; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            f(ig, i) = utils::random<double_complex>();
+        }
+        /* G=0 component of a real function is real */
+        if (reduce__ && Communicator::world().rank() == 0) {
+            f(0, i) = f(0, i).real();
+        }
+        data.push_back(&f(0, i));
+        weights.push_back(utils::random<double>());
+    }
+
+    /* reference: transform each band and accumulate */
+    std::vector<double> rho_ref(fft.local_size(), 0);
+    for (int i = 0; i < num_bands; i++) {
+        fft.transform<1>(data[i]);
+        for (int ir = 0; ir < fft.local_size(); ir++) {
+            rho_ref[ir] += weights[i] * std::norm(fft.buffer(ir));
+        }
+    }
+
+    std::vector<double> rho(fft.local_size(), 0);
+    fft.accumulate_density(data, weights, rho.data());
+
+    double diff{0};
+    for (int ir = 0; ir < fft.local_size(); ir++) {
+        diff += std::pow(rho[ir] - rho_ref[ir], 2);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / fft.size());
+
+    fft.dismiss();
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* transform a random function with two FFT drivers which differ in the setting applied by config(fft, i) for
+   i = 0, 1; the real-space values and the G-vector coefficients after the transformation back must agree within
+   the tolerance (bit for bit if the tolerance is zero) */
+template <typename F>
+int test_fft_config(cmd_args& args, device_t fft_pu__, bool reduce__, F&& config__, double tol__ = 0)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    auto dims = find_translations(cutoff, M);
+
+    /* some of the settings take effect in prepare(), so two FFT drivers are needed */
+    FFT3D fft1(dims, Communicator::world(), fft_pu__);
+    FFT3D fft2(dims, Communicator::world(), fft_pu__);
+    config__(fft1, 0);
+    config__(fft2, 1);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft1.comm(), Communicator::self());
+
+    fft1.prepare(gvp);
+    fft2.prepare(gvp);
+
+    int ngv = gvp.gvec_count_fft();
+
+    mdarray<double_complex, 1> f(ngv);
+    for (int ig = 0; ig < ngv; ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    /* G=0 component of a real function is real */
+    if (reduce__ && Communicator::world().rank() == 0) {
+        f[0] = f[0].real();
+    }
+
+    mdarray<double_complex, 1> g1(ngv);
+    mdarray<double_complex, 1> g2(ngv);
+    fft1.transform<1>(f.at(memory_t::host));
+    fft2.transform<1>(f.at(memory_t::host));
+
+    int diff{0};
+    for (int ir = 0; ir < fft1.local_size(); ir++) {
+        if (std::abs(fft1.buffer(ir) - fft2.buffer(ir)) > tol__) {
+            diff++;
+        }
+    }
+    fft1.transform<-1>(g1.at(memory_t::host));
+    fft2.transform<-1>(g2.at(memory_t::host));
+    for (int ig = 0; ig < ngv; ig++) {
+        if (std::abs(g1[ig] - g2[ig]) > tol__) {
+            diff++;
+        }
+    }
+    Communicator::world().allreduce(&diff, 1);
+
+    fft1.dismiss();
+    fft2.dismiss();
+
+    if (diff) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_grid_radix(cmd_args& args, device_t fft_pu__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    auto dims = find_translations(cutoff, M);
+
+    /* each rank measures its own weights first; the next call on the global communicator must give the weights
+       of the rank 0 to all ranks */
+    calibrate_fft_radix_cost<double>(Communicator::self());
+    auto w_min = calibrate_fft_radix_cost<double>(Communicator::world()).weight;
+    auto w_max = w_min;
+    Communicator::world().allreduce<double, mpi_op_t::min>(w_min.data(), static_cast<int>(w_min.size()));
+    Communicator::world().allreduce<double, mpi_op_t::max>(w_max.data(), static_cast<int>(w_max.size()));
+    if (w_min != w_max) {
+        return 1;
+    }
+
+    /* grid with factors up to 11 chosen by the calibrated cost model */
+    FFT3D_grid grid(dims, Communicator::world().size(), calibrate_fft_radix_cost<double>(Communicator::world()));
+
+    for (int i = 0; i < 3; i++) {
+        if (grid.size(i) < dims[i]) {
+            return 1;
+        }
+    }
+
+    FFT3D fft(grid, Communicator::world(), fft_pu__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), false);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    mdarray<double_complex, 1> f(gvp.gvec_count_fft());
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    mdarray<double_complex, 1> g(gvp.gvec_count_fft());
+
+    fft.transform<1>(f.at(memory_t::host));
+    fft.transform<-1>(g.at(memory_t::host));
+
+    double diff{0};
+    for (int ig = 0; ig < gvp.gvec_count_fft(); ig++) {
+        diff += std::pow(std::abs(f[ig] - g[ig]), 2);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff = std::sqrt(diff / gvec.num_gvec());
+
+    fft.dismiss();
+
+    if (diff > 1e-10) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_async(cmd_args& args, device_t fft_pu__, bool reduce__, bool a2a_neighbor__, bool a2a_shm__,
+                   a2a_compression_t a2a_compression__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+    fft.a2a_neighbor(a2a_neighbor__);
+    fft.a2a_shm(a2a_shm__);
+    fft.a2a_compression(a2a_compression__);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    fft.prepare(gvp);
+
+    int ngv = gvp.gvec_count_fft();
+
+    mdarray<double_complex, 2> f(ngv, 2);
+    for (int i = 0; i < 2; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            f(ig, i) = utils::random<double_complex>();
+        }
+        if (reduce__ && Communicator::world().rank() == 0) {
+            f(0, i) = f(0, i).real();
+        }
+    }
+
+    /* reference results of the synchronous transformations; the asynchronous transformations must use the same
+       exchange, so the results are identical also with the lossy compression of the payload */
+    std::vector<double_complex> fr[2];
+    mdarray<double_complex, 2> g(ngv, 2);
+    for (int i = 0; i < 2; i++) {
+        fft.transform<1>(f.at(memory_t::host, 0, i));
+        fr[i] = std::vector<double_complex>(&fft.buffer(0), &fft.buffer(0) + fft.local_size());
+        fft.transform<-1>(g.at(memory_t::host, 0, i));
+    }
+
+    int diff{0};
+
+    /* two backward transformations in flight */
+    auto req1 = fft.transform_async<1>(f.at(memory_t::host, 0, 0));
+    auto req2 = fft.transform_async<1>(f.at(memory_t::host, 0, 1));
+    req1.wait();
+    for (int ir = 0; ir < fft.local_size(); ir++) {
+        if (fft.buffer(ir) != fr[0][ir]) {
+            diff++;
+        }
+    }
+    while (!req2.test()) {
+    }
+    for (int ir = 0; ir < fft.local_size(); ir++) {
+        if (fft.buffer(ir) != fr[1][ir]) {
+            diff++;
+        }
+    }
+
+    /* two forward transformations in flight */
+    mdarray<double_complex, 2> h(ngv, 2);
+    for (int i = 0; i < 2; i++) {
+        std::copy(fr[i].begin(), fr[i].end(), &fft.buffer(0));
+        req1 = fft.transform_async<-1>(h.at(memory_t::host, 0, i));
+        std::swap(req1, req2);
+    }
+    req2.wait();
+    req1.wait();
+    for (int i = 0; i < 2; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            if (h(ig, i) != g(ig, i)) {
+                diff++;
+            }
+        }
+    }
+
+    /* a handle which is overwritten by the move assignment or goes out of scope completes its transformation */
+    h.zero();
+    {
+        std::copy(fr[0].begin(), fr[0].end(), &fft.buffer(0));
+        auto req = fft.transform_async<-1>(h.at(memory_t::host, 0, 0));
+        std::copy(fr[1].begin(), fr[1].end(), &fft.buffer(0));
+        req = fft.transform_async<-1>(h.at(memory_t::host, 0, 1));
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int ig = 0; ig < ngv; ig++) {
+            if (h(ig, i) != g(ig, i)) {
+                diff++;
+            }
+        }
+    }
+    Communicator::world().allreduce(&diff, 1);
+
+    fft.dismiss();
+
+    if (diff) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_fft_memory_pool(cmd_args& args, device_t fft_pu__, bool reduce__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    auto dims = find_translations(cutoff, M);
+
+    /* the exchange through the shared window would bypass the pipelined and asynchronous paths */
+    FFT3D fft(dims, Communicator::world(), fft_pu__);
+    fft.a2a_shm(false);
+
+    Gvec gvec(M, cutoff, Communicator::world(), reduce__);
+
+    Gvec_partition gvp(gvec, fft.comm(), Communicator::self());
+
+    int ngv = gvp.gvec_count_fft();
+
+    mdarray<double_complex, 1> f(ngv);
+    for (int ig = 0; ig < ngv; ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    if (reduce__ && Communicator::world().rank() == 0) {
+        f[0] = f[0].real();
+    }
+
+    /* reference with the buffers owned by the FFT driver */
+    fft.prepare(gvp);
+    fft.transform<1>(f.at(memory_t::host));
+    std::vector<double_complex> fr(&fft.buffer(0), &fft.buffer(0) + fft.local_size());
+    mdarray<double_complex, 1> g_ref(ngv);
+    fft.transform<-1>(g_ref.at(memory_t::host));
+    std::vector<double> veff(fft.local_size());
+    for (auto& v : veff) {
+        v = utils::random<double>();
+    }
+    mdarray<double_complex, 1> h_ref(ngv);
+    fft.apply_local(f.at(memory_t::host), veff.data(), h_ref.at(memory_t::host));
+    fft.dismiss();
+
+    int const num_fft{3};
+
+    int diff{0};
+
+    /* two FFT drivers take their buffers from the same pool one after another */
+    memory_pool mp(memory_t::host);
+    FFT3D fft1(dims, Communicator::world(), fft_pu__);
+    fft1.a2a_shm(false);
+    for (auto ptr : {&fft, &fft1}) {
+        ptr->prepare(gvp, mp);
+        ptr->transform<1>(f.at(memory_t::host));
+        for (int ir = 0; ir < ptr->local_size(); ir++) {
+            if (ptr->buffer(ir) != fr[ir]) {
+                diff++;
+            }
+        }
+        mdarray<double_complex, 1> g(ngv);
+        ptr->transform<-1>(g.at(memory_t::host));
+        for (int ig = 0; ig < ngv; ig++) {
+            if (g[ig] != g_ref[ig]) {
+                diff++;
+            }
+        }
+        /* the work buffers of the batched, pipelined and asynchronous transformations come from the pool too */
+        mdarray<double_complex, 2> fb(ngv, num_fft);
+        mdarray<double_complex, 2> gb(ngv, num_fft);
+        std::vector<double_complex*> fptr(num_fft);
+        std::vector<double_complex*> gptr(num_fft);
+        for (int i = 0; i < num_fft; i++) {
+            std::copy(f.at(memory_t::host), f.at(memory_t::host) + ngv, fb.at(memory_t::host, 0, i));
+            fptr[i] = fb.at(memory_t::host, 0, i);
+            gptr[i] = gb.at(memory_t::host, 0, i);
+        }
+        ptr->transform_batch<1>(fptr);
+        for (int i = 0; i < num_fft; i++) {
+            for (int ir = 0; ir < ptr->local_size(); ir++) {
+                if (ptr->buffer_batch(num_fft)(ir, i) != fr[ir]) {
+                    diff++;
+                }
+            }
+        }
+        ptr->apply_local(fptr, veff.data(), gptr);
+        for (int i = 0; i < num_fft; i++) {
+            for (int ig = 0; ig < ngv; ig++) {
+                if (gb(ig, i) != h_ref[ig]) {
+                    diff++;
+                }
+            }
+        }
+        {
+            auto req = ptr->transform_async<1>(f.at(memory_t::host));
+            req.wait();
+        }
+        for (int ir = 0; ir < ptr->local_size(); ir++) {
+            if (ptr->buffer(ir) != fr[ir]) {
+                diff++;
+            }
+        }
+        ptr->dismiss();
+        /* all buffers are returned to the pool */
+        if (mp.num_stored_ptr() != 0) {
+            diff++;
+        }
+    }
+
+    /* the driver works again with its own buffers */
+    fft.prepare(gvp);
+    fft.transform<1>(f.at(memory_t::host));
+    for (int ir = 0; ir < fft.local_size(); ir++) {
+        if (fft.buffer(ir) != fr[ir]) {
+            diff++;
+        }
+    }
+    fft.dismiss();
+
+    Communicator::world().allreduce(&diff, 1);
+
+    if (diff) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_gvec_interpolation(cmd_args& args, device_t fft_pu__, bool reduce__)
+{
+    double cutoff = args.value<double>("cutoff", 40);
+
+    matrix3d<double> M = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    FFT3D fft_coarse(find_translations(cutoff, M), Communicator::world(), fft_pu__);
+    FFT3D fft_fine(find_translations(2 * cutoff, M), Communicator::world(), fft_pu__);
+
+    Gvec gvec_coarse(M, cutoff, Communicator::world(), reduce__);
+    Gvec gvec_fine(2 * cutoff, gvec_coarse);
+
+    Gvec_partition gvp_coarse(gvec_coarse, fft_coarse.comm(), Communicator::self());
+    Gvec_partition gvp_fine(gvec_fine, fft_fine.comm(), Communicator::self());
+
+    Gvec_interpolation interp(gvp_coarse, gvp_fine);
+
+    fft_coarse.prepare(gvp_coarse);
+    fft_fine.prepare(gvp_fine);
+
+    int ngv_coarse = gvp_coarse.gvec_count_fft();
+    int ngv_fine   = gvp_fine.gvec_count_fft();
+
+    mdarray<double_complex, 1> f(ngv_coarse);
+    for (int ig = 0; ig < ngv_coarse; ig++) {
+        f[ig] = utils::random<double_complex>();
+    }
+    if (reduce__ && Communicator::world().rank() == 0) {
+        f[0] = f[0].real();
+    }
+
+    mdarray<double_complex, 1> f_fine(ngv_fine);
+    interp.coarse_to_fine(f.at(memory_t::host), f_fine.at(memory_t::host));
+
+    /* the same function on both grids has the same norm */
+    double nrm[] = {0, 0};
+    fft_coarse.transform<1>(f.at(memory_t::host));
+    for (int ir = 0; ir < fft_coarse.local_size(); ir++) {
+        nrm[0] += std::norm(fft_coarse.buffer(ir)) / fft_coarse.size();
+    }
+    fft_fine.transform<1>(f_fine.at(memory_t::host));
+    for (int ir = 0; ir < fft_fine.local_size(); ir++) {
+        nrm[1] += std::norm(fft_fine.buffer(ir)) / fft_fine.size();
+    }
+    Communicator::world().allreduce(nrm, 2);
+
+    /* fine grid values are transformed back and restricted to the original coefficients */
+    fft_fine.transform<-1>(f_fine.at(memory_t::host));
+    mdarray<double_complex, 1> g(ngv_coarse);
+    interp.fine_to_coarse(f_fine.at(memory_t::host), g.at(memory_t::host));
+
+    double diff{0};
+    for (int ig = 0; ig < ngv_coarse; ig++) {
+        diff += std::abs(g[ig] - f[ig]);
+    }
+    Communicator::world().allreduce(&diff, 1);
+    diff /= gvec_coarse.num_gvec();
+
+    fft_coarse.dismiss();
+    fft_fine.dismiss();
+
+    if (diff > 1e-10 || std::abs(nrm[0] - nrm[1]) > 1e-10 * nrm[0]) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int test_task_queues()
+{
+    int nt = omp_get_max_threads();
+
+    /* uneven initial ranges including empty ones, so that most of the tasks are stolen */
+    int num_tasks{1000};
+    std::vector<int> first_task(nt + 1, num_tasks);
+    first_task[0] = 0;
+
+    std::vector<int> count(num_tasks, 0);
+
+    task_queues queues(first_task);
+    #pragma omp parallel
+    {
+        int task;
+        while (queues.next(omp_get_thread_num(), task)) {
+            #pragma omp atomic
+            count[task]++;
+        }
+    }
+
+    for (int i = 0; i < num_tasks; i++) {
+        if (count[i] != 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int run_test(cmd_args& args)
 {
     int result = test_fft_complex(args, CPU);
+    result += test_fft_pencil(args, CPU);
+    result += test_fft_real(args, CPU);
+    result += test_fft_batch(args, CPU);
+    result += test_fft_layout_cache(args, CPU);
+    result += test_fft_apply_local(args, CPU, false);
+    result += test_fft_apply_local(args, CPU, true);
+    result += test_fft_apply_local_pipeline(args, CPU, false, false, false, a2a_compression_t::none);
+    result += test_fft_apply_local_pipeline(args, CPU, true, false, false, a2a_compression_t::none);
+    result += test_fft_apply_local_pipeline(args, CPU, false, true, false, a2a_compression_t::none);
+    result += test_fft_apply_local_pipeline(args, CPU, true, true, false, a2a_compression_t::none);
+    result += test_fft_apply_local_pipeline(args, CPU, false, true, true, a2a_compression_t::none);
+    result += test_fft_apply_local_pipeline(args, CPU, false, false, false, a2a_compression_t::fixed16);
+    result += test_fft_density(args, CPU, false);
+    result += test_fft_density(args, CPU, true);
+    for (bool reduce : {false, true}) {
+        /* double buffering of the all-to-all exchange */
+        result += test_fft_config(args, CPU, reduce, [](FFT3D& fft, int i) { fft.a2a_double_buffer(i == 0); });
+        /* neighborhood collective for the exchange */
+        result += test_fft_config(args, CPU, reduce, [](FFT3D& fft, int i) { fft.a2a_neighbor(i == 0); });
+        /* pipelined z-transformation with the exchange split into chunks of z-columns */
+        result += test_fft_config(args, CPU, reduce, [](FFT3D& fft, int i) { fft.a2a_chunks(i == 0 ? 3 : 1); });
+        /* shared memory transport for the exchange */
+        result += test_fft_config(args, CPU, reduce, [](FFT3D& fft, int i) { fft.a2a_shm(i == 0); });
+        /* xy-planes distributed between threads or transformed by all threads */
+        result += test_fft_config(args, CPU, reduce,
+                                  [](FFT3D& fft, int i) { fft.xy_split_planes(i == 0 ? 0 : 1 << 30); }, 1e-10);
+        /* pruned transformation of short z-columns */
+        result += test_fft_config(args, CPU, reduce, [](FFT3D& fft, int i) { fft.z_pruning(i == 0); }, 1e-10);
+    }
+    result += test_fft_async(args, CPU, false, false, false, a2a_compression_t::none);
+    result += test_fft_async(args, CPU, true, false, false, a2a_compression_t::none);
+    result += test_fft_async(args, CPU, false, true, false, a2a_compression_t::none);
+    result += test_fft_async(args, CPU, true, true, false, a2a_compression_t::none);
+    result += test_fft_async(args, CPU, false, true, true, a2a_compression_t::none);
+    result += test_fft_async(args, CPU, false, false, false, a2a_compression_t::fixed16);
+    result += test_fft_memory_pool(args, CPU, false);
+    result += test_fft_memory_pool(args, CPU, true);
+    result += test_task_queues();
+    result += test_gvec_interpolation(args, CPU, false);
+    result += test_gvec_interpolation(args, CPU, true);
+    result += test_fft_grid_radix(args, CPU);
+    result += test_fft_float(args, CPU, false);
+    result += test_fft_float(args, CPU, true);
+    result += test_fft_compression(args, CPU, a2a_compression_t::single);
+    result += test_fft_compression(args, CPU, a2a_compression_t::fixed16);
+    result += test_fft_compression(args, CPU, a2a_compression_t::fixed8);
 #ifdef __GPU
     result += test_fft_complex(args, GPU);
 #endif